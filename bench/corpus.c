@@ -0,0 +1,202 @@
+// Synthetic C sources for the front end benchmarks. Every shape stresses
+// one part of the lexer, "mixed" rotates through all of them.
+#include "bench/corpus.h"
+#include "helpers/buffer.h"
+#include <string.h>
+
+const char *corpus_shapes[] = {"identifiers", "comments", "parens", "strings", "numbers", "hexbin", "mixed", NULL};
+
+static const char *corpus_keywords[] = {"int", "unsigned", "long", "char", "return", "if", "while", "struct", "static", "const"};
+static const char *corpus_syllables[] = {"buf", "len", "node", "ptr", "count", "value", "next", "data", "tmp", "idx", "sum", "key"};
+static const char *corpus_operators[] = {"+", "-", "*", "<<", ">>", "&", "|", "^", "==", "!=", "<=", "&&", "||"};
+
+#define CORPUS_PICK(seed, array) array[corpus_rand(seed) % (sizeof(array) / sizeof(array[0]))]
+
+static unsigned int corpus_rand(unsigned int *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+static void corpus_identifier(struct buffer *out, unsigned int *seed)
+{
+    buffer_printf(out, "%s", CORPUS_PICK(seed, corpus_syllables));
+    if (corpus_rand(seed) % 2)
+        buffer_printf(out, "_%s", CORPUS_PICK(seed, corpus_syllables));
+    if (corpus_rand(seed) % 3 == 0)
+        buffer_printf(out, "%u", corpus_rand(seed) % 100);
+}
+
+// int value_next = buf + len3 * key;
+static void corpus_identifiers(struct buffer *out, unsigned int *seed)
+{
+    buffer_printf(out, "%s ", CORPUS_PICK(seed, corpus_keywords));
+    corpus_identifier(out, seed);
+    buffer_printf(out, " = ");
+    int terms = 1 + corpus_rand(seed) % 6;
+    for (int i = 0; i < terms; i++)
+    {
+        if (i)
+            buffer_printf(out, " %s ", CORPUS_PICK(seed, corpus_operators));
+        corpus_identifier(out, seed);
+    }
+    buffer_printf(out, ";\n");
+}
+
+static void corpus_words(struct buffer *out, unsigned int *seed, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        buffer_printf(out, " %s", CORPUS_PICK(seed, corpus_syllables));
+    }
+}
+
+// Mostly comment text with a statement now and then
+static void corpus_comments(struct buffer *out, unsigned int *seed)
+{
+    switch (corpus_rand(seed) % 4)
+    {
+    case 0:
+    case 1:
+        buffer_printf(out, "//");
+        corpus_words(out, seed, 4 + corpus_rand(seed) % 12);
+        buffer_printf(out, "\n");
+        break;
+    case 2:
+        buffer_printf(out, "/*");
+        int lines = 1 + corpus_rand(seed) % 6;
+        for (int i = 0; i < lines; i++)
+        {
+            corpus_words(out, seed, 4 + corpus_rand(seed) % 10);
+            buffer_printf(out, i + 1 < lines ? "\n *" : " */\n");
+        }
+        break;
+    default:
+        corpus_identifiers(out, seed);
+        break;
+    }
+}
+
+static void corpus_paren_expression(struct buffer *out, unsigned int *seed, int depth)
+{
+    if (depth == 0)
+    {
+        corpus_identifier(out, seed);
+        return;
+    }
+    buffer_write(out, '(');
+    corpus_paren_expression(out, seed, depth - 1);
+    buffer_printf(out, " %s ", CORPUS_PICK(seed, corpus_operators));
+    if (corpus_rand(seed) % 4 == 0)
+        corpus_paren_expression(out, seed, corpus_rand(seed) % depth);
+    else
+        buffer_printf(out, "%u", corpus_rand(seed) % 1000);
+    buffer_write(out, ')');
+}
+
+// x = ((((a + 1) * 2) ...)), nesting up to 64 deep
+static void corpus_parens(struct buffer *out, unsigned int *seed)
+{
+    corpus_identifier(out, seed);
+    buffer_printf(out, " = ");
+    corpus_paren_expression(out, seed, 1 + corpus_rand(seed) % 64);
+    buffer_printf(out, ";\n");
+}
+
+// char *s = "...", 64 to 1024 characters with an escape now and then
+static void corpus_strings(struct buffer *out, unsigned int *seed)
+{
+    buffer_printf(out, "const char *");
+    corpus_identifier(out, seed);
+    buffer_printf(out, " = \"");
+    int len = 64 + corpus_rand(seed) % 961;
+    for (int i = 0; i < len; i++)
+    {
+        unsigned int r = corpus_rand(seed);
+        if (r % 97 == 0)
+            buffer_printf(out, r % 2 ? "\\n" : "\\\"");
+        else if (r % 7 == 0)
+            buffer_write(out, ' ');
+        else
+            buffer_write(out, 'a' + r % 26);
+    }
+    buffer_printf(out, "\";\n");
+}
+
+// Rows of a large lookup table. The parser has no initializer lists yet,
+// so every row is a call with the row as arguments
+static void corpus_numbers(struct buffer *out, unsigned int *seed)
+{
+    buffer_printf(out, "row(");
+    for (int i = 0; i < 16; i++)
+    {
+        unsigned int r = corpus_rand(seed);
+        buffer_printf(out, i ? ", %u" : "%u", r % 3 ? r % 256 : r * 65599u);
+    }
+    buffer_printf(out, ");\n");
+}
+
+static void corpus_hexbin(struct buffer *out, unsigned int *seed)
+{
+    buffer_printf(out, "row(");
+    for (int i = 0; i < 8; i++)
+    {
+        unsigned int r = corpus_rand(seed);
+        if (i)
+            buffer_printf(out, ", ");
+        switch (r % 4)
+        {
+        case 0:
+            buffer_printf(out, "0x%X", r * 2654435761u);
+            break;
+        case 1:
+            buffer_printf(out, "0x%x", r % 4096);
+            break;
+        case 2:
+            buffer_printf(out, "0b");
+            for (int bit = 8 + r % 24; bit >= 0; bit--)
+                buffer_write(out, '0' + ((r >> (bit % 16)) & 1));
+            break;
+        default:
+            buffer_printf(out, "%uL", r);
+            break;
+        }
+    }
+    buffer_printf(out, ");\n");
+}
+
+bool corpus_shape_exists(const char *shape)
+{
+    for (const char **name = corpus_shapes; *name; name++)
+    {
+        if (strcmp(*name, shape) == 0)
+            return true;
+    }
+    return false;
+}
+
+void corpus_generate(struct buffer *out, const char *shape, size_t size, unsigned int seed)
+{
+    size_t start = out->len;
+
+    int line = 0;
+    while ((size_t)out->len - start < size)
+    {
+        const char *current = shape;
+        if (strcmp(shape, "mixed") == 0)
+            current = corpus_shapes[line++ % 6];
+
+        if (strcmp(current, "identifiers") == 0)
+            corpus_identifiers(out, &seed);
+        else if (strcmp(current, "comments") == 0)
+            corpus_comments(out, &seed);
+        else if (strcmp(current, "parens") == 0)
+            corpus_parens(out, &seed);
+        else if (strcmp(current, "strings") == 0)
+            corpus_strings(out, &seed);
+        else if (strcmp(current, "numbers") == 0)
+            corpus_numbers(out, &seed);
+        else
+            corpus_hexbin(out, &seed);
+    }
+}
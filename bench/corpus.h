@@ -0,0 +1,20 @@
+#ifndef BENCH_CORPUS_H
+#define BENCH_CORPUS_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+struct buffer;
+
+// Shapes understood by corpus_generate, NULL terminated
+extern const char *corpus_shapes[];
+
+bool corpus_shape_exists(const char *shape);
+
+/**
+ * Writes about size bytes of C source of the given shape to out.
+ * The same shape, size and seed always give the same bytes
+ */
+void corpus_generate(struct buffer *out, const char *shape, size_t size, unsigned int seed);
+
+#endif
@@ -0,0 +1,27 @@
+// Writes a synthetic C source to stdout, see bench/corpus.c for the shapes.
+//
+// usage: corpus_gen shape [size_kb] [seed]
+#include "bench/corpus.h"
+#include "helpers/buffer.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || !corpus_shape_exists(argv[1]))
+    {
+        fprintf(stderr, "usage: corpus_gen shape [size_kb] [seed]\nshapes:");
+        for (const char **shape = corpus_shapes; *shape; shape++)
+            fprintf(stderr, " %s", *shape);
+        fprintf(stderr, "\n");
+        return 1;
+    }
+    size_t size = (argc > 2 ? strtoul(argv[2], NULL, 10) : 1024) * 1024;
+    unsigned int seed = argc > 3 ? strtoul(argv[3], NULL, 10) : 12345;
+
+    struct buffer *out = buffer_create();
+    corpus_generate(out, argv[1], size, seed);
+    fwrite(buffer_ptr(out), 1, out->len, stdout);
+    buffer_free(out);
+    return 0;
+}
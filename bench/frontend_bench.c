@@ -0,0 +1,168 @@
+// Runs lex() and parse() in process on generated corpora (or on files) and
+// reports throughput. Allocations are counted by linking with
+// -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc, see the makefile.
+//
+// usage: frontend_bench [-s size_kb] [-r rounds] [-seed n] [shape|file...]
+#include "compiler.h"
+#include "bench/corpus.h"
+#include "helpers/buffer.h"
+#include "helpers/vector.h"
+#include <time.h>
+
+static long bench_allocations = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    bench_allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    bench_allocations++;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    bench_allocations++;
+    return __real_realloc(ptr, size);
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct bench_result
+{
+    double lex_time;
+    double parse_time;
+    int tokens;
+    int nodes;
+    long allocations;
+};
+
+static struct bench_result bench_run_once(const char *name, const char *data, size_t size)
+{
+    struct bench_result result = {0};
+    struct compile_process *cprocess = compile_process_create_for_source(name, data, size, NULL, 0);
+    struct lex_process_functions functions = {0};
+    long allocations = bench_allocations;
+
+    double start = now();
+    struct lex_process *lexer = lex_process_create(cprocess, &functions, NULL);
+    lex_process_set_source(lexer, data, size);
+    if (lex(lexer) != LEXICAL_ANALYSIS_ALL_OK)
+    {
+        fprintf(stderr, "%s: lex failed\n", name);
+        exit(1);
+    }
+    cprocess->tokens = lexer->tokens;
+    lexer->tokens = NULL;
+    lex_process_free(lexer);
+    double lexed = now();
+    if (parse(cprocess) != PARSE_ALL_OK)
+    {
+        fprintf(stderr, "%s: parse failed\n", name);
+        exit(1);
+    }
+    double parsed = now();
+
+    result.lex_time = lexed - start;
+    result.parse_time = parsed - lexed;
+    result.tokens = cprocess->tokens->count;
+    result.nodes = node_count(cprocess);
+    result.allocations = bench_allocations - allocations;
+    compile_process_free(cprocess);
+    return result;
+}
+
+// Best time of all rounds for each phase
+static void bench_run(const char *name, const char *data, size_t size, int rounds)
+{
+    struct bench_result best = bench_run_once(name, data, size);
+    for (int round = 1; round < rounds; round++)
+    {
+        struct bench_result result = bench_run_once(name, data, size);
+        if (result.lex_time < best.lex_time)
+            best.lex_time = result.lex_time;
+        if (result.parse_time < best.parse_time)
+            best.parse_time = result.parse_time;
+    }
+
+    double mb = size / (1024.0 * 1024.0);
+    printf("%-12s %8.2f %10.1f %12.0f %12.0f %10.1f %12.3f\n", name, mb, mb / best.lex_time, best.tokens / best.lex_time,
+           best.nodes / best.parse_time, mb / (best.lex_time + best.parse_time), (double)best.allocations / best.tokens);
+}
+
+static char *bench_read_file(const char *filename, size_t *size)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp)
+        return NULL;
+    fseek(fp, 0, SEEK_END);
+    *size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *data = malloc(*size + 1);
+    *size = fread(data, 1, *size, fp);
+    fclose(fp);
+    return data;
+}
+
+int main(int argc, char **argv)
+{
+    size_t size = 4 * 1024 * 1024;
+    int rounds = 5;
+    unsigned int seed = 12345;
+    struct vector *inputs = vector_create(sizeof(const char *));
+    for (int i = 1; i < argc; i++)
+    {
+        if (S_EQ(argv[i], "-s") && i + 1 < argc)
+            size = strtoul(argv[++i], NULL, 10) * 1024;
+        else if (S_EQ(argv[i], "-r") && i + 1 < argc)
+            rounds = atoi(argv[++i]);
+        else if (S_EQ(argv[i], "-seed") && i + 1 < argc)
+            seed = strtoul(argv[++i], NULL, 10);
+        else
+            vector_push(inputs, &argv[i]);
+    }
+    if (vector_empty(inputs))
+    {
+        for (const char **shape = corpus_shapes; *shape; shape++)
+            vector_push(inputs, shape);
+    }
+
+    printf("best of %d rounds\n", rounds < 1 ? 1 : rounds);
+    printf("%-12s %8s %10s %12s %12s %10s %12s\n", "input", "MB", "lex MB/s", "tokens/s", "nodes/s", "total MB/s", "allocs/token");
+    for (int i = 0; i < vector_count(inputs); i++)
+    {
+        const char *input = *(const char **)vector_at(inputs, i);
+        if (corpus_shape_exists(input))
+        {
+            struct buffer *corpus = buffer_create();
+            corpus_generate(corpus, input, size, seed);
+            bench_run(input, buffer_ptr(corpus), corpus->len, rounds);
+            buffer_free(corpus);
+            continue;
+        }
+
+        size_t file_size = 0;
+        char *data = bench_read_file(input, &file_size);
+        if (!data)
+        {
+            fprintf(stderr, "Could not open %s\n", input);
+            return 1;
+        }
+        bench_run(input, data, file_size, rounds);
+        free(data);
+    }
+    vector_free(inputs);
+    return 0;
+}
@@ -0,0 +1,434 @@
+// Microbenchmarks for struct vector, struct buffer and the parser's checkpoints.
+// Every case runs a few warmup repetitions and then reports the spread of the
+// timed ones in ns per operation. -csv and -json print machine readable results,
+// -label tags the rows so the output of two builds can be joined and compared.
+//
+// usage: helpers_bench [-n ops] [-r repetitions] [-w warmup] [-csv | -json] [-label name] [case...]
+#include "compiler.h"
+#include "helpers/vector.h"
+#include "helpers/buffer.h"
+#include <time.h>
+
+VECTOR_DEFINE_TYPED(bench_ptr_vec, void *)
+
+// Keeps the compiler from dropping the measured work
+static volatile uintptr_t bench_sink;
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Every case sets up its own state, does ops operations and returns the nanoseconds
+// spent on the operations alone
+typedef double (*BENCH_CASE_FUNCTION)(int ops);
+
+static struct vector *bench_filled_vector(size_t esize, int count)
+{
+    struct vector *vector = vector_create(esize);
+    char elem[sizeof(struct token)] = {0};
+    for (int i = 0; i < count; i++)
+    {
+        elem[0] = i;
+        vector_push(vector, elem);
+    }
+    return vector;
+}
+
+static double bench_vector_push(size_t esize, int ops)
+{
+    struct vector *vector = vector_create(esize);
+    char elem[sizeof(struct token)] = {0};
+    double start = now_ns();
+    for (int i = 0; i < ops; i++)
+    {
+        elem[0] = i;
+        vector_push(vector, elem);
+    }
+    double time = now_ns() - start;
+    bench_sink += vector_count(vector);
+    vector_free(vector);
+    return time;
+}
+
+static double bench_vector_push_token(int ops)
+{
+    return bench_vector_push(sizeof(struct token), ops);
+}
+
+static double bench_vector_push_ptr(int ops)
+{
+    return bench_vector_push(sizeof(void *), ops);
+}
+
+static double bench_vector_push_ptr_typed(int ops)
+{
+    struct vector *vector = vector_create(sizeof(void *));
+    double start = now_ns();
+    for (int i = 0; i < ops; i++)
+    {
+        bench_ptr_vec_push(vector, (void *)(uintptr_t)i);
+    }
+    double time = now_ns() - start;
+    bench_sink += vector_count(vector);
+    vector_free(vector);
+    return time;
+}
+
+static double bench_vector_peek(size_t esize, int ops)
+{
+    struct vector *vector = bench_filled_vector(esize, ops);
+    vector_set_peek_pointer(vector, 0);
+    uintptr_t sum = 0;
+    double start = now_ns();
+    for (int i = 0; i < ops; i++)
+    {
+        sum += *(char *)vector_peek(vector);
+    }
+    double time = now_ns() - start;
+    bench_sink += sum;
+    vector_free(vector);
+    return time;
+}
+
+static double bench_vector_peek_token(int ops)
+{
+    return bench_vector_peek(sizeof(struct token), ops);
+}
+
+static double bench_vector_peek_ptr(int ops)
+{
+    return bench_vector_peek(sizeof(void *), ops);
+}
+
+// What a backtracking parser does: save, look a few elements ahead, restore
+static double bench_vector_save_restore(size_t esize, int ops)
+{
+    struct vector *vector = bench_filled_vector(esize, 64);
+    vector_set_peek_pointer(vector, 0);
+    uintptr_t sum = 0;
+    double start = now_ns();
+    for (int i = 0; i < ops; i++)
+    {
+        vector_save(vector);
+        for (int j = 0; j < 4; j++)
+            sum += *(char *)vector_peek(vector);
+        vector_restore(vector);
+    }
+    double time = now_ns() - start;
+    bench_sink += sum;
+    vector_free(vector);
+    return time;
+}
+
+static double bench_vector_save_restore_token(int ops)
+{
+    return bench_vector_save_restore(sizeof(struct token), ops);
+}
+
+static double bench_vector_save_restore_ptr(int ops)
+{
+    return bench_vector_save_restore(sizeof(void *), ops);
+}
+
+// The parser's checkpoint: node_mark, a few nodes built speculatively, node_rewind.
+// A few nodes sit on the stack below the mark, like an enclosing expression
+static double bench_node_mark_rewind(int ops)
+{
+    struct compile_process *process = compile_process_create_for_source("bench", "", 0, NULL, 0);
+    for (int i = 0; i < 8; i++)
+        node_create(process, &(struct node){.type = NODE_TYPE_IDENTIFIER});
+    double start = now_ns();
+    for (int i = 0; i < ops; i++)
+    {
+        struct node_mark mark;
+        node_mark(process, &mark);
+        for (int j = 0; j < 4; j++)
+            node_create(process, &(struct node){.type = NODE_TYPE_NUMBER, .value = j});
+        node_rewind(process, &mark);
+    }
+    double time = now_ns() - start;
+    bench_sink += node_count(process);
+    compile_process_free(process);
+    return time;
+}
+
+// parse() over ops copies of statement, only the parse is timed
+static double bench_parse_statements(const char *statement, int ops)
+{
+    struct buffer *source = buffer_create();
+    for (int i = 0; i < ops; i++)
+        buffer_printf(source, "%s\n", statement);
+    struct compile_process *process = compile_process_create_for_source("bench", buffer_ptr(source), source->len, NULL, 0);
+    struct lex_process_functions functions = {0};
+    struct lex_process *lexer = lex_process_create(process, &functions, NULL);
+    lex_process_set_source(lexer, buffer_ptr(source), source->len);
+    if (lex(lexer) != LEXICAL_ANALYSIS_ALL_OK)
+    {
+        fprintf(stderr, "Could not lex \"%s\"\n", statement);
+        exit(1);
+    }
+    process->tokens = lexer->tokens;
+    lexer->tokens = NULL;
+    lex_process_free(lexer);
+
+    double start = now_ns();
+    parse(process);
+    double time = now_ns() - start;
+    bench_sink += node_count(process);
+    compile_process_free(process);
+    buffer_free(source);
+    return time;
+}
+
+// parse_try succeeds, the checkpoint is taken and dropped
+static double bench_parse_declaration(int ops)
+{
+    return bench_parse_statements("int a = 1;", ops);
+}
+
+// parse_try fails at the '(' and rewinds to the checkpoint before the statement is skipped
+static double bench_parse_declaration_rewind(int ops)
+{
+    return bench_parse_statements("int (*f)(void);", ops);
+}
+
+// Removes from the middle of a 1024 element vector, pushing back keeps the size steady
+static double bench_vector_pop_at(size_t esize, int ops)
+{
+    struct vector *vector = bench_filled_vector(esize, 1024);
+    char elem[sizeof(struct token)] = {0};
+    double start = now_ns();
+    for (int i = 0; i < ops; i++)
+    {
+        vector_pop_at(vector, (i * 7) % 1024);
+        vector_push(vector, elem);
+    }
+    double time = now_ns() - start;
+    bench_sink += vector_count(vector);
+    vector_free(vector);
+    return time;
+}
+
+static double bench_vector_pop_at_token(int ops)
+{
+    return bench_vector_pop_at(sizeof(struct token), ops);
+}
+
+static double bench_vector_pop_at_ptr(int ops)
+{
+    return bench_vector_pop_at(sizeof(void *), ops);
+}
+
+static double bench_buffer_write(int ops)
+{
+    struct buffer *buffer = buffer_create();
+    double start = now_ns();
+    for (int i = 0; i < ops; i++)
+    {
+        buffer_write(buffer, 'a' + i % 26);
+    }
+    double time = now_ns() - start;
+    bench_sink += buffer->len;
+    buffer_free(buffer);
+    return time;
+}
+
+static double bench_buffer_write_n(int ops)
+{
+    static const char chunk[] = "identifier_name_";
+    struct buffer *buffer = buffer_create();
+    double start = now_ns();
+    for (int i = 0; i < ops; i++)
+    {
+        buffer_write_n(buffer, chunk, sizeof(chunk) - 1);
+    }
+    double time = now_ns() - start;
+    bench_sink += buffer->len;
+    buffer_free(buffer);
+    return time;
+}
+
+static double bench_buffer_printf(int ops)
+{
+    struct buffer *buffer = buffer_create();
+    double start = now_ns();
+    for (int i = 0; i < ops; i++)
+    {
+        buffer_printf(buffer, "%s %i ", "token", i);
+    }
+    double time = now_ns() - start;
+    bench_sink += buffer->len;
+    buffer_free(buffer);
+    return time;
+}
+
+static double bench_buffer_read(int ops)
+{
+    struct buffer *buffer = buffer_create();
+    for (int i = 0; i < ops; i++)
+    {
+        buffer_write(buffer, 'a' + i % 26);
+    }
+    uintptr_t sum = 0;
+    double start = now_ns();
+    for (int i = 0; i < ops; i++)
+    {
+        sum += buffer_read(buffer);
+    }
+    double time = now_ns() - start;
+    bench_sink += sum;
+    buffer_free(buffer);
+    return time;
+}
+
+struct bench_case
+{
+    const char *name;
+    BENCH_CASE_FUNCTION function;
+};
+
+static struct bench_case bench_cases[] = {
+    {"vector_push_token", bench_vector_push_token},
+    {"vector_push_ptr", bench_vector_push_ptr},
+    {"vector_push_ptr_typed", bench_vector_push_ptr_typed},
+    {"vector_peek_token", bench_vector_peek_token},
+    {"vector_peek_ptr", bench_vector_peek_ptr},
+    {"vector_save_restore_token", bench_vector_save_restore_token},
+    {"vector_save_restore_ptr", bench_vector_save_restore_ptr},
+    {"vector_pop_at_token", bench_vector_pop_at_token},
+    {"vector_pop_at_ptr", bench_vector_pop_at_ptr},
+    {"buffer_write", bench_buffer_write},
+    {"buffer_write_n", bench_buffer_write_n},
+    {"buffer_printf", bench_buffer_printf},
+    {"buffer_read", bench_buffer_read},
+    {"node_mark_rewind", bench_node_mark_rewind},
+    {"parse_declaration", bench_parse_declaration},
+    {"parse_declaration_rewind", bench_parse_declaration_rewind},
+    {NULL, NULL}};
+
+enum
+{
+    BENCH_FORMAT_TABLE,
+    BENCH_FORMAT_CSV,
+    BENCH_FORMAT_JSON
+};
+
+struct bench_options
+{
+    int ops;
+    int repetitions;
+    int warmup;
+    int format;
+    const char *label;
+};
+
+static int bench_compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest rank on the sorted samples
+static double bench_percentile(double *sorted, int count, int percentile)
+{
+    int index = (count * percentile + 99) / 100 - 1;
+    return sorted[index < 0 ? 0 : index];
+}
+
+static void bench_run_case(struct bench_options *options, struct bench_case *bench, bool first)
+{
+    for (int i = 0; i < options->warmup; i++)
+    {
+        bench->function(options->ops);
+    }
+    double *samples = malloc(options->repetitions * sizeof(double));
+    for (int i = 0; i < options->repetitions; i++)
+    {
+        samples[i] = bench->function(options->ops) / options->ops;
+    }
+    qsort(samples, options->repetitions, sizeof(double), bench_compare_double);
+
+    int count = options->repetitions;
+    double min = samples[0];
+    double p50 = bench_percentile(samples, count, 50);
+    double p90 = bench_percentile(samples, count, 90);
+    double p99 = bench_percentile(samples, count, 99);
+    double max = samples[count - 1];
+    switch (options->format)
+    {
+    case BENCH_FORMAT_CSV:
+        printf("%s,%s,%i,%i,%.3f,%.3f,%.3f,%.3f,%.3f\n", options->label, bench->name, options->ops, count, min, p50, p90, p99, max);
+        break;
+    case BENCH_FORMAT_JSON:
+        printf("%s\n  {\"label\":\"%s\",\"case\":\"%s\",\"ops\":%i,\"repetitions\":%i,\"min_ns\":%.3f,\"p50_ns\":%.3f,\"p90_ns\":%.3f,\"p99_ns\":%.3f,\"max_ns\":%.3f}",
+               first ? "" : ",", options->label, bench->name, options->ops, count, min, p50, p90, p99, max);
+        break;
+    default:
+        printf("%-26s %9.2f %9.2f %9.2f %9.2f %9.2f\n", bench->name, min, p50, p90, p99, max);
+        break;
+    }
+    free(samples);
+}
+
+int main(int argc, char **argv)
+{
+    struct bench_options options = {.ops = 100000, .repetitions = 50, .warmup = 5, .format = BENCH_FORMAT_TABLE, .label = "default"};
+    struct vector *selected = vector_create(sizeof(struct bench_case *));
+    for (int i = 1; i < argc; i++)
+    {
+        if (S_EQ(argv[i], "-n") && i + 1 < argc)
+            options.ops = atoi(argv[++i]);
+        else if (S_EQ(argv[i], "-r") && i + 1 < argc)
+            options.repetitions = atoi(argv[++i]);
+        else if (S_EQ(argv[i], "-w") && i + 1 < argc)
+            options.warmup = atoi(argv[++i]);
+        else if (S_EQ(argv[i], "-label") && i + 1 < argc)
+            options.label = argv[++i];
+        else if (S_EQ(argv[i], "-csv"))
+            options.format = BENCH_FORMAT_CSV;
+        else if (S_EQ(argv[i], "-json"))
+            options.format = BENCH_FORMAT_JSON;
+        else
+        {
+            struct bench_case *bench = bench_cases;
+            while (bench->name && !S_EQ(bench->name, argv[i]))
+                bench++;
+            if (!bench->name)
+            {
+                fprintf(stderr, "Unknown case %s\n", argv[i]);
+                return 1;
+            }
+            vector_push(selected, &bench);
+        }
+    }
+    if (options.ops < 1 || options.repetitions < 1 || options.warmup < 0)
+    {
+        fprintf(stderr, "usage: helpers_bench [-n ops] [-r repetitions] [-w warmup] [-csv | -json] [-label name] [case...]\n");
+        return 1;
+    }
+    if (vector_empty(selected))
+    {
+        for (struct bench_case *bench = bench_cases; bench->name; bench++)
+            vector_push(selected, &bench);
+    }
+
+    if (options.format == BENCH_FORMAT_CSV)
+        printf("label,case,ops,repetitions,min_ns,p50_ns,p90_ns,p99_ns,max_ns\n");
+    else if (options.format == BENCH_FORMAT_JSON)
+        printf("[");
+    else
+        printf("%-26s %9s %9s %9s %9s %9s  (ns/op, %i ops, %i repetitions)\n", "case", "min", "p50", "p90", "p99", "max", options.ops, options.repetitions);
+
+    for (int i = 0; i < vector_count(selected); i++)
+    {
+        bench_run_case(&options, *(struct bench_case **)vector_at(selected, i), i == 0);
+    }
+    if (options.format == BENCH_FORMAT_JSON)
+        printf("\n]\n");
+    vector_free(selected);
+    return 0;
+}
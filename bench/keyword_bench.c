@@ -0,0 +1,153 @@
+// Lexes the identifier heavy corpus with lex() and reports how fast identifiers
+// and keywords go through the whole lexer. As a secondary number, the same
+// words are run through keyword_classify and through the strcmp chain the
+// lexer used before.
+//
+// usage: keyword_bench [-s size_kb] [-r rounds] [-seed n]
+#include "compiler.h"
+#include "bench/corpus.h"
+#include "helpers/buffer.h"
+#include <time.h>
+
+static bool is_keyword_chain(const char *str)
+{
+    return S_EQ(str, "unsigned") || S_EQ(str, "signed") || S_EQ(str, "char") || S_EQ(str, "short") ||
+           S_EQ(str, "int") || S_EQ(str, "float") || S_EQ(str, "double") || S_EQ(str, "long") ||
+           S_EQ(str, "void") || S_EQ(str, "struct") || S_EQ(str, "union") || S_EQ(str, "static") ||
+           S_EQ(str, "__ignore_typecheck__") || S_EQ(str, "return") || S_EQ(str, "include") ||
+           S_EQ(str, "sizeof") || S_EQ(str, "if") || S_EQ(str, "else") || S_EQ(str, "while") ||
+           S_EQ(str, "for") || S_EQ(str, "do") || S_EQ(str, "break") || S_EQ(str, "continue") ||
+           S_EQ(str, "switch") || S_EQ(str, "case") || S_EQ(str, "default") || S_EQ(str, "goto") ||
+           S_EQ(str, "typedef") || S_EQ(str, "const") || S_EQ(str, "extern") || S_EQ(str, "restrict");
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// An identifier or keyword in the corpus
+struct bench_word
+{
+    uint32_t offset;
+    uint32_t len;
+};
+
+// One full lex of the corpus, the words are collected once after the timing
+static double bench_lex(const char *data, size_t size, int *tokens, struct bench_word **words, int *word_count)
+{
+    struct compile_process *cprocess = compile_process_create_for_source("keyword_bench", data, size, NULL, 0);
+    struct lex_process_functions functions = {0};
+    double start = now();
+    struct lex_process *lexer = lex_process_create(cprocess, &functions, NULL);
+    lex_process_set_source(lexer, data, size);
+    if (lex(lexer) != LEXICAL_ANALYSIS_ALL_OK)
+    {
+        fprintf(stderr, "keyword_bench: the corpus does not lex\n");
+        exit(1);
+    }
+    double time = now() - start;
+
+    struct token_store *store = lexer->tokens;
+    *tokens = store->count;
+    if (!*words)
+    {
+        *words = malloc(store->count * sizeof(struct bench_word));
+        *word_count = 0;
+        for (int i = 0; i < store->count; i++)
+        {
+            if (store->type[i] == TOKEN_TYPE_IDENTIFIER || store->type[i] == TOKEN_TYPE_KEYWORLD)
+                (*words)[(*word_count)++] = (struct bench_word){.offset = store->offset[i], .len = store->cold[i].slen};
+        }
+    }
+    lex_process_free(lexer);
+    compile_process_free(cprocess);
+    return time;
+}
+
+int main(int argc, char **argv)
+{
+    size_t size = 4 * 1024 * 1024;
+    int rounds = 5;
+    unsigned int seed = 12345;
+    for (int i = 1; i < argc; i++)
+    {
+        if (S_EQ(argv[i], "-s") && i + 1 < argc)
+            size = strtoul(argv[++i], NULL, 10) * 1024;
+        else if (S_EQ(argv[i], "-r") && i + 1 < argc)
+            rounds = atoi(argv[++i]);
+        else if (S_EQ(argv[i], "-seed") && i + 1 < argc)
+            seed = strtoul(argv[++i], NULL, 10);
+        else
+        {
+            fprintf(stderr, "usage: keyword_bench [-s size_kb] [-r rounds] [-seed n]\n");
+            return 1;
+        }
+    }
+    if (rounds < 1)
+        rounds = 1;
+
+    struct buffer *corpus = buffer_create();
+    corpus_generate(corpus, "identifiers", size, seed);
+    const char *text = buffer_ptr(corpus);
+
+    int tokens = 0;
+    struct bench_word *words = NULL;
+    int word_count = 0;
+    double best_lex = 1e9;
+    for (int round = 0; round < rounds; round++)
+    {
+        double time = bench_lex(text, corpus->len, &tokens, &words, &word_count);
+        if (time < best_lex)
+            best_lex = time;
+    }
+
+    double best_chain = 1e9;
+    double best_switch = 1e9;
+    char ident[64];
+    for (int round = 0; round < rounds; round++)
+    {
+        long chain_hits = 0;
+        long switch_hits = 0;
+
+        // Old path: copy the identifier into a NULL terminated string and run the chain
+        double start = now();
+        for (int i = 0; i < word_count; i++)
+        {
+            size_t len = words[i].len < sizeof(ident) ? words[i].len : sizeof(ident) - 1;
+            memcpy(ident, text + words[i].offset, len);
+            ident[len] = 0x00;
+            chain_hits += is_keyword_chain(ident);
+        }
+        double chain_time = now() - start;
+
+        // New path: classify the span in place
+        start = now();
+        for (int i = 0; i < word_count; i++)
+        {
+            switch_hits += keyword_classify(text + words[i].offset, words[i].len) != KEYWORD_NONE;
+        }
+        double switch_time = now() - start;
+
+        if (chain_hits != switch_hits)
+        {
+            fprintf(stderr, "keyword_classify disagrees with the strcmp chain: %ld vs %ld\n", switch_hits, chain_hits);
+            return 1;
+        }
+        if (chain_time < best_chain)
+            best_chain = chain_time;
+        if (switch_time < best_switch)
+            best_switch = switch_time;
+    }
+
+    double mb = corpus->len / (1024.0 * 1024.0);
+    printf("identifiers corpus: %.2f MB, %d tokens, %d identifiers and keywords, best of %d rounds\n", mb, tokens, word_count, rounds);
+    printf("lex():            %8.1f MB/s %8.2f ns/token %8.2f ns/identifier\n", mb / best_lex, best_lex * 1e9 / tokens, best_lex * 1e9 / word_count);
+    printf("classify only:    %8.2f ns/identifier with keyword_classify, %.2f with the strcmp chain (%.2fx)\n", best_switch * 1e9 / word_count,
+           best_chain * 1e9 / word_count, best_chain / best_switch);
+    free(words);
+    buffer_free(corpus);
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include "check/check.h"
+#include "compiler.h"
+
+unsigned int check_rand(unsigned int *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+static void check_usage(const char *name, struct check_option *options)
+{
+    fprintf(stderr, "usage: %s", name);
+    for (struct check_option *option = options; option->flag; option++)
+    {
+        fprintf(stderr, " [%s %s]", option->flag, option->argument);
+    }
+    fprintf(stderr, " [-seed n]\n");
+}
+
+bool check_parse_args(int argc, char **argv, const char *name, struct check_option *options, unsigned int *seed)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+        {
+            check_usage(name, options);
+            return false;
+        }
+        if (S_EQ(argv[i], "-seed"))
+        {
+            *seed = strtoul(argv[++i], NULL, 10);
+            continue;
+        }
+
+        struct check_option *option = options;
+        while (option->flag && !S_EQ(argv[i], option->flag))
+            option++;
+        if (!option->flag)
+        {
+            check_usage(name, options);
+            return false;
+        }
+        const char *argument = argv[++i];
+        if (option->kind == CHECK_OPTION_SIZE_KB)
+            *(size_t *)option->value = strtoul(argument, NULL, 10) * 1024;
+        else
+            *(int *)option->value = atoi(argument);
+    }
+    return true;
+}
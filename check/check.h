@@ -0,0 +1,39 @@
+#ifndef CHECK_CHECK_H
+#define CHECK_CHECK_H
+
+#include <stdbool.h>
+
+// Every check starts from this seed unless -seed is given
+#define CHECK_DEFAULT_SEED 12345
+
+/**
+ * A small LCG, the same seed gives the same sequence on every platform
+ */
+unsigned int check_rand(unsigned int *seed);
+
+enum
+{
+    // value points at an int
+    CHECK_OPTION_INT,
+    // value points at a size_t, the argument is in KB
+    CHECK_OPTION_SIZE_KB
+};
+
+// A "-flag argument" option of a check
+struct check_option
+{
+    const char *flag;
+    // Shown in the usage line, e.g. "size_kb"
+    const char *argument;
+    int kind;
+    void *value;
+};
+
+/**
+ * Parses argv against options, which end with a NULL flag. -seed n is always
+ * accepted and stored in seed. Anything else prints the usage of name to
+ * stderr and returns false
+ */
+bool check_parse_args(int argc, char **argv, const char *name, struct check_option *options, unsigned int *seed);
+
+#endif
@@ -0,0 +1,558 @@
+// Differential test for the lexer. A deliberately naive reference lexer, one
+// character at a time and one switch case per character like the lexer before
+// the class table and the scan kernels, runs next to lex() on every corpus
+// shape and on random token soup. Every token field the later phases can see
+// has to match, with every scan kernel the CPU supports.
+//
+// The oracle is not the lexer from before this series. That one kept its state
+// in globals, pulled characters through lex_process_functions, filled the old
+// struct token with line/col instead of offsets and between_brackets, and
+// cannot be built against the current compiler.h. It also lexed strings
+// differently: a backslash was dropped and the next character was read as if
+// it were unescaped, so "a\"b" ended at the second quote and "x\\" lost both
+// backslashes. Since the SIMD scan change the character after a backslash is
+// kept and never ends the string. The reference lexer below follows the new
+// rule on purpose, and the escape cases in the token soup pin it down.
+#include "compiler.h"
+#include "bench/corpus.h"
+#include "check/check.h"
+#include "helpers/buffer.h"
+#include "helpers/scan.h"
+#include <setjmp.h>
+
+struct ref_token
+{
+    int type;
+    uint32_t offset;
+    bool whitespace;
+    struct span between_brackets;
+    int num_type;
+    size_t slen;
+    // keyword/operator id, number value or symbol character
+    unsigned long long value;
+    // identifier/string/comment text
+    const char *str;
+    size_t str_len;
+};
+
+struct ref_lexer
+{
+    const char *src;
+    size_t size;
+    size_t pos;
+    struct ref_token *tokens;
+    int count;
+    int capacity;
+    int depth;
+    uint32_t expression_start;
+    int expression_first_token;
+    // Unescaped string contents
+    struct buffer *strings;
+    const char *error;
+};
+
+static int ref_peek(struct ref_lexer *lexer, size_t ahead)
+{
+    return lexer->pos + ahead < lexer->size ? (unsigned char)lexer->src[lexer->pos + ahead] : -1;
+}
+
+static struct ref_token *ref_push(struct ref_lexer *lexer, int type, size_t start)
+{
+    if (lexer->count == lexer->capacity)
+    {
+        lexer->capacity = lexer->capacity ? lexer->capacity * 2 : 256;
+        lexer->tokens = realloc(lexer->tokens, lexer->capacity * sizeof(struct ref_token));
+    }
+    struct ref_token *token = &lexer->tokens[lexer->count++];
+    *token = (struct ref_token){.type = type, .offset = start};
+    if (lexer->depth > 0)
+        token->between_brackets.offset = lexer->expression_start;
+    return token;
+}
+
+static struct ref_token *ref_last(struct ref_lexer *lexer)
+{
+    return lexer->count ? &lexer->tokens[lexer->count - 1] : NULL;
+}
+
+static void ref_close_span(struct ref_lexer *lexer, size_t end)
+{
+    for (int i = lexer->expression_first_token; i < lexer->count; i++)
+    {
+        if (lexer->tokens[i].between_brackets.offset)
+            lexer->tokens[i].between_brackets.len = end - lexer->expression_start;
+    }
+}
+
+static void ref_number_suffix(struct ref_lexer *lexer, struct ref_token *token)
+{
+    if (ref_peek(lexer, 0) == 'L')
+    {
+        token->num_type = NUMBER_TYPE_LONG;
+        lexer->pos++;
+    }
+    else if (ref_peek(lexer, 0) == 'f')
+    {
+        token->num_type = NUMBER_TYPE_FLOAT;
+        lexer->pos++;
+    }
+}
+
+static bool ref_is_digit(int c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static bool ref_is_hex(int c)
+{
+    return ref_is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static bool ref_is_identifier(int c)
+{
+    return ref_is_digit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static void ref_identifier(struct ref_lexer *lexer)
+{
+    size_t start = lexer->pos;
+    while (ref_is_identifier(ref_peek(lexer, 0)))
+        lexer->pos++;
+    size_t len = lexer->pos - start;
+    for (int keyword = KEYWORD_NONE + 1; keyword < KEYWORD_COUNT; keyword++)
+    {
+        const char *str = keyword_str(keyword);
+        if (strlen(str) == len && memcmp(str, lexer->src + start, len) == 0)
+        {
+            struct ref_token *token = ref_push(lexer, TOKEN_TYPE_KEYWORLD, start);
+            token->value = keyword;
+            token->slen = len;
+            return;
+        }
+    }
+    struct ref_token *token = ref_push(lexer, TOKEN_TYPE_IDENTIFIER, start);
+    token->str = lexer->src + start;
+    token->str_len = token->slen = len;
+}
+
+// 0x1f and 0b101 are lexed as a 0 followed by an identifier, the 0 is replaced
+static void ref_special_number(struct ref_lexer *lexer)
+{
+    struct ref_token *last = ref_last(lexer);
+    if (!last || last->type != TOKEN_TYPE_NUMBER || last->value != 0)
+    {
+        ref_identifier(lexer);
+        return;
+    }
+    size_t start = last->offset;
+    lexer->count--;
+    unsigned long long value = 0;
+    if (lexer->src[lexer->pos++] == 'x')
+    {
+        while (ref_is_hex(ref_peek(lexer, 0)))
+        {
+            int c = lexer->src[lexer->pos++];
+            value = value * 16 + (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+        }
+    }
+    else
+    {
+        while (ref_is_digit(ref_peek(lexer, 0)))
+        {
+            int c = lexer->src[lexer->pos++];
+            if (c != '0' && c != '1')
+            {
+                lexer->error = "This is not a valid binary number";
+                return;
+            }
+            value = value * 2 + (c - '0');
+        }
+    }
+    struct ref_token *token = ref_push(lexer, TOKEN_TYPE_NUMBER, start);
+    token->value = value;
+    ref_number_suffix(lexer, token);
+}
+
+static void ref_string(struct ref_lexer *lexer, char end)
+{
+    size_t start = lexer->pos++;
+    size_t string = lexer->strings->len;
+    // A backslash keeps the next character, whatever it is
+    while (lexer->pos < lexer->size && lexer->src[lexer->pos] != end)
+    {
+        if (lexer->src[lexer->pos] == '\\' && lexer->pos + 1 < lexer->size)
+            lexer->pos++;
+        buffer_write(lexer->strings, lexer->src[lexer->pos++]);
+    }
+    if (lexer->pos < lexer->size)
+        lexer->pos++;
+    struct ref_token *token = ref_push(lexer, TOKEN_TYPE_STRING, start);
+    token->str = (const char *)(uintptr_t)string;
+    token->str_len = token->slen = lexer->strings->len - string;
+}
+
+static void ref_operator(struct ref_lexer *lexer)
+{
+    size_t start = lexer->pos;
+    struct ref_token *last = ref_last(lexer);
+    if (lexer->src[start] == '<' && last && last->type == TOKEN_TYPE_KEYWORLD && last->value == KEYWORD_INCLUDE)
+    {
+        ref_string(lexer, '>');
+        return;
+    }
+    int best = OPERATOR_NONE;
+    size_t best_len = 0;
+    for (int op = OPERATOR_NONE + 1; op < OPERATOR_COUNT; op++)
+    {
+        const char *str = operator_str(op);
+        size_t len = strlen(str);
+        if (len > best_len && len <= lexer->size - start && memcmp(str, lexer->src + start, len) == 0)
+        {
+            best = op;
+            best_len = len;
+        }
+    }
+    lexer->pos += best_len;
+    struct ref_token *token = ref_push(lexer, TOKEN_TYPE_OPERATOR, start);
+    token->value = best;
+    if (best == OPERATOR_LEFT_PAREN && ++lexer->depth == 1)
+    {
+        lexer->expression_start = lexer->pos;
+        lexer->expression_first_token = lexer->count - 1;
+    }
+}
+
+static void ref_comment(struct ref_lexer *lexer)
+{
+    size_t start = lexer->pos;
+    lexer->pos += 2;
+    size_t text = lexer->pos;
+    size_t text_end;
+    if (lexer->src[start + 1] == '/')
+    {
+        while (ref_peek(lexer, 0) != '\n' && ref_peek(lexer, 0) != -1)
+            lexer->pos++;
+        text_end = lexer->pos;
+    }
+    else
+    {
+        while (!(ref_peek(lexer, 0) == '*' && ref_peek(lexer, 1) == '/'))
+        {
+            if (ref_peek(lexer, 0) == -1)
+            {
+                lexer->error = "You did not close this multiline comment";
+                return;
+            }
+            lexer->pos++;
+        }
+        text_end = lexer->pos;
+        lexer->pos += 2;
+    }
+    struct ref_token *token = ref_push(lexer, TOKEN_TYPE_COMMENT, start);
+    token->str = lexer->src + text;
+    token->str_len = token->slen = text_end - text;
+}
+
+static void ref_quote(struct ref_lexer *lexer)
+{
+    size_t start = lexer->pos++;
+    int c = ref_peek(lexer, 0);
+    lexer->pos++;
+    if (c == '\\')
+    {
+        int escaped = ref_peek(lexer, 0);
+        lexer->pos++;
+        c = escaped == 'n' ? '\n' : escaped == 't' ? '\t' : escaped == '\\' ? '\\' : escaped == '\'' ? '\'' : 0;
+    }
+    if (ref_peek(lexer, 0) != '\'')
+    {
+        lexer->error = "You opened a quote ' but did not close it with a ' character ";
+        return;
+    }
+    lexer->pos++;
+    struct ref_token *token = ref_push(lexer, TOKEN_TYPE_NUMBER, start);
+    token->value = (unsigned char)c;
+}
+
+static void ref_lex(struct ref_lexer *lexer)
+{
+    while (lexer->pos < lexer->size && !lexer->error)
+    {
+        size_t start = lexer->pos;
+        int c = lexer->src[start];
+        switch (c)
+        {
+        case ' ':
+        case '\t':
+            if (ref_last(lexer))
+                ref_last(lexer)->whitespace = true;
+            lexer->pos++;
+            break;
+        case '\n':
+            lexer->pos++;
+            ref_push(lexer, TOKEN_TYPE_NEWLINE, start);
+            break;
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+        {
+            unsigned long long value = 0;
+            while (ref_is_digit(ref_peek(lexer, 0)))
+                value = value * 10 + (lexer->src[lexer->pos++] - '0');
+            struct ref_token *token = ref_push(lexer, TOKEN_TYPE_NUMBER, start);
+            token->value = value;
+            ref_number_suffix(lexer, token);
+            break;
+        }
+        case 'b':
+        case 'x':
+            ref_special_number(lexer);
+            break;
+        case '/':
+            if (ref_peek(lexer, 1) == '/' || ref_peek(lexer, 1) == '*')
+                ref_comment(lexer);
+            else
+                ref_operator(lexer);
+            break;
+        case '+': case '-': case '*': case '<': case '>': case '^': case '%': case '!':
+        case '=': case '~': case '|': case '&': case '(': case '[': case ',': case '.': case '?':
+            ref_operator(lexer);
+            break;
+        case ')':
+            if (--lexer->depth < 0)
+            {
+                lexer->error = "You closed an expression that you never opened\n";
+                break;
+            }
+            if (lexer->depth == 0)
+                ref_close_span(lexer, start);
+            // fall through
+        case '{': case '}': case ':': case ';': case '#': case '\\': case ']':
+            lexer->pos++;
+            ref_push(lexer, TOKEN_TYPE_SYMBOL, start)->value = (unsigned char)c;
+            break;
+        case '"':
+            ref_string(lexer, '"');
+            break;
+        case '\'':
+            ref_quote(lexer);
+            break;
+        default:
+            if (ref_is_identifier(c))
+                ref_identifier(lexer);
+            else
+                lexer->error = "Unexpected token!";
+        }
+    }
+    if (!lexer->error && lexer->depth > 0)
+        ref_close_span(lexer, lexer->size);
+}
+
+// Only the message is compared, the lexer reports the position differently
+static void dump_error(struct buffer *out, const char *msg)
+{
+    size_t len = strcspn(msg, "\n");
+    const char *position = strstr(msg, " on line");
+    if (position && (size_t)(position - msg) < len)
+        len = position - msg;
+    buffer_printf(out, "error: %.*s\n", (int)len, msg);
+}
+
+static void dump_common(struct buffer *out, int index, int type, uint32_t offset, bool whitespace, struct span span, int num_type, size_t slen)
+{
+    buffer_printf(out, "%i: type %i offset %u ws %i brackets %u+%u num %i slen %zu ", index, type, offset, whitespace, span.offset, span.len, num_type, slen);
+}
+
+static void dump_text(struct buffer *out, const char *str, size_t len)
+{
+    buffer_write(out, '[');
+    buffer_write_n(out, str, len);
+    buffer_printf(out, "]\n");
+}
+
+static void dump_reference(struct buffer *out, struct ref_lexer *lexer)
+{
+    if (lexer->error)
+    {
+        dump_error(out, lexer->error);
+        return;
+    }
+    for (int i = 0; i < lexer->count; i++)
+    {
+        struct ref_token *token = &lexer->tokens[i];
+        dump_common(out, i, token->type, token->offset, token->whitespace, token->between_brackets, token->num_type, token->slen);
+        if (token->type == TOKEN_TYPE_STRING)
+            dump_text(out, (const char *)buffer_ptr(lexer->strings) + (uintptr_t)token->str, token->str_len);
+        else if (token->type == TOKEN_TYPE_IDENTIFIER || token->type == TOKEN_TYPE_COMMENT)
+            dump_text(out, token->str, token->str_len);
+        else
+            buffer_printf(out, "%llu\n", token->value);
+    }
+}
+
+static void dump_lexer(struct buffer *out, const char *src, size_t size)
+{
+    struct compile_process *cprocess = compile_process_create_for_source("check", src, size, NULL, 0);
+    struct buffer *diagnostics = buffer_create();
+    cprocess->diagnostics = diagnostics;
+    struct lex_process_functions functions = {0};
+    struct lex_process *lexer = lex_process_create(cprocess, &functions, NULL);
+    lex_process_set_source(lexer, src, size);
+
+    cprocess->error_jmp_set = true;
+    if (setjmp(cprocess->error_jmp) != 0)
+    {
+        dump_error(out, buffer_ptr(diagnostics));
+        goto out;
+    }
+    lex(lexer);
+
+    struct token_store *tokens = lexer->tokens;
+    for (int i = 0; i < tokens->count; i++)
+    {
+        struct token token;
+        token_store_get(tokens, i, &token);
+        dump_common(out, i, token.type, token.offset, token.whitespace, token.between_brackets, token.num.type, token.slen);
+        switch (token.type)
+        {
+        case TOKEN_TYPE_IDENTIFIER:
+        case TOKEN_TYPE_STRING:
+        case TOKEN_TYPE_COMMENT:
+            dump_text(out, token.sval, token.slen);
+            break;
+        case TOKEN_TYPE_KEYWORLD:
+            buffer_printf(out, "%i\n", token.keyword);
+            break;
+        case TOKEN_TYPE_OPERATOR:
+            buffer_printf(out, "%i\n", token.op);
+            break;
+        case TOKEN_TYPE_SYMBOL:
+            buffer_printf(out, "%i\n", (unsigned char)token.cval);
+            break;
+        case TOKEN_TYPE_NUMBER:
+            buffer_printf(out, "%llu\n", token.llnum);
+            break;
+        default:
+            buffer_printf(out, "0\n");
+        }
+    }
+
+out:
+    cprocess->error_jmp_set = false;
+    lex_process_free(lexer);
+    compile_process_free(cprocess);
+    buffer_free(diagnostics);
+}
+
+// Random fragments that exercise the corners the corpus shapes never reach
+static void random_source(struct buffer *out, unsigned int seed, int fragments)
+{
+    static const char *pieces[] = {
+        "0x1F", "0XAB", "0b1011", "0 x12", "0 b", "0L", "12f", "007", "18446744073709551615", "99999999999999999999",
+        "'a'", "'\\n'", "'\\t'", "'\\\\'", "'\\''", "'\\q'", "\"\"", "\"a\\\"b\"", "\"tab\\there\"", "\"x\\\\\"",
+        "#include <stdio.h>", "#include<a\\>b>", "include", "...", "..", "->", ">>=", "<<=", "&&", "||", "!=",
+        "a.b", "x", "b", "xy", "bx1", "_", "int", "unsigned", "sizeof", "struct", "return",
+        "/* c */", "/***/", "/* a\n * b */", "// line\n", "/", "/=", "*", "{", "}", ";", ":", "#", "\\", "[", "]", "?", ",",
+        " ", "\t", "  \t ", "\n", "\n\n"};
+    int depth = 0;
+    for (int i = 0; i < fragments; i++)
+    {
+        unsigned int r = check_rand(&seed);
+        if (r % 11 == 0)
+        {
+            buffer_write(out, '(');
+            depth++;
+        }
+        else if (r % 11 == 1 && depth > 0)
+        {
+            buffer_write(out, ')');
+            depth--;
+        }
+        else
+        {
+            buffer_printf(out, "%s", pieces[r % (sizeof(pieces) / sizeof(pieces[0]))]);
+        }
+        if (check_rand(&seed) % 3)
+            buffer_write(out, ' ');
+    }
+    // Left open on purpose now and then, the span then runs to the end of the file
+    while (depth > 0 && seed % 4)
+    {
+        buffer_write(out, ')');
+        depth--;
+    }
+}
+
+static int check_source(const char *name, const char *src, size_t size)
+{
+    struct ref_lexer reference = {.src = src, .size = size, .strings = buffer_create()};
+    ref_lex(&reference);
+    struct buffer *expected = buffer_create();
+    dump_reference(expected, &reference);
+    free(reference.tokens);
+    buffer_free(reference.strings);
+
+    int failed = 0;
+    for (int impl = SCAN_IMPL_AVX2; impl >= SCAN_IMPL_SCALAR && !failed; impl--)
+    {
+        if (scan_select(impl) != impl)
+            continue;
+        struct buffer *actual = buffer_create();
+        dump_lexer(actual, src, size);
+        const char *a = buffer_ptr(expected);
+        const char *b = buffer_ptr(actual);
+        failed = expected->len != actual->len || memcmp(a, b, expected->len) != 0;
+        if (failed)
+        {
+            size_t line = 0;
+            size_t i = 0;
+            while (i < (size_t)expected->len && i < (size_t)actual->len && a[i] == b[i])
+            {
+                if (a[i] == '\n')
+                    line = i + 1;
+                i++;
+            }
+            fprintf(stderr, "%s: lexer differs from the reference with the %s kernels\n  reference: %.*s\n  lexer:     %.*s\n", name, scan_active->name,
+                    (int)strcspn(a + line, "\n"), a + line, (int)strcspn(b + line, "\n"), b + line);
+        }
+        buffer_free(actual);
+    }
+    scan_select(SCAN_IMPL_AVX2);
+    buffer_free(expected);
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    size_t size = 64 * 1024;
+    int random_sources = 500;
+    unsigned int seed = CHECK_DEFAULT_SEED;
+    struct check_option options[] = {{"-s", "size_kb", CHECK_OPTION_SIZE_KB, &size}, {"-n", "random_sources", CHECK_OPTION_INT, &random_sources}, {NULL}};
+    if (!check_parse_args(argc, argv, "lex_diff", options, &seed))
+    {
+        return 1;
+    }
+
+    int failed = 0;
+    int checked = 0;
+    for (const char **shape = corpus_shapes; *shape; shape++)
+    {
+        struct buffer *corpus = buffer_create();
+        corpus_generate(corpus, *shape, size, seed);
+        failed += check_source(*shape, buffer_ptr(corpus), corpus->len);
+        checked++;
+        buffer_free(corpus);
+    }
+    for (int i = 0; i < random_sources; i++)
+    {
+        struct buffer *source = buffer_create();
+        random_source(source, seed + i, 1 + i % 200);
+        char name[32];
+        snprintf(name, sizeof(name), "random %u", seed + i);
+        failed += check_source(name, buffer_ptr(source), source->len);
+        checked++;
+        buffer_free(source);
+    }
+
+    printf("lex_diff: %i of %i sources match the reference lexer\n", checked - failed, checked);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,125 @@
+// Checks the iterative node walks against a recursive walk. Random trees are
+// built with node_create/node_append_child, children are attached in random
+// order, and the harness keeps its own child lists next to the store. Preorder,
+// postorder and preorder with random node_walk_skip_children calls have to visit
+// the same ids as the recursive walk, from the root and from random subtrees.
+#include "compiler.h"
+#include "check/check.h"
+#include "helpers/vector.h"
+
+#define CHECK_MAX_NODES 512
+
+// The tree as the harness built it, children in the order they were appended
+struct check_tree
+{
+    node_id children[CHECK_MAX_NODES][CHECK_MAX_NODES];
+    int child_count[CHECK_MAX_NODES];
+    // Nodes a preorder walk with skips does not enter
+    bool skip[CHECK_MAX_NODES];
+    node_id order[CHECK_MAX_NODES];
+    int count;
+};
+
+static void check_recurse(struct check_tree *tree, node_id id, int walk_order, bool use_skip)
+{
+    if (walk_order == NODE_WALK_PREORDER)
+        tree->order[tree->count++] = id;
+    if (!use_skip || !tree->skip[id])
+    {
+        for (int i = 0; i < tree->child_count[id]; i++)
+            check_recurse(tree, tree->children[id][i], walk_order, use_skip);
+    }
+    if (walk_order == NODE_WALK_POSTORDER)
+        tree->order[tree->count++] = id;
+}
+
+static int check_walk(struct compile_process *process, struct check_tree *tree, node_id root, int walk_order, bool use_skip)
+{
+    tree->count = 0;
+    check_recurse(tree, root, walk_order, use_skip);
+
+    struct node_walk walk;
+    node_walk_begin(&walk, process, root, walk_order);
+    int i = 0;
+    for (node_id id = node_walk_next(&walk); id; id = node_walk_next(&walk), i++)
+    {
+        if (i >= tree->count || id != tree->order[i])
+            return i;
+        if (use_skip && tree->skip[id])
+            node_walk_skip_children(&walk);
+    }
+    return i == tree->count ? -1 : i;
+}
+
+static int check_tree(struct compile_process *process, struct check_tree *tree, unsigned int *seed)
+{
+    node_store_clear(process->nodes);
+    memset(tree->child_count, 0, sizeof(tree->child_count));
+
+    // Node i gets a parent below i, so any attach order still builds a tree
+    int count = 1 + check_rand(seed) % (CHECK_MAX_NODES - NODE_ROOT - 1);
+    node_id ids[CHECK_MAX_NODES];
+    for (int i = 0; i < count; i++)
+    {
+        ids[i] = node_create(process, &(struct node){.type = NODE_TYPE_NUMBER, .value = i});
+        node_pop(process);
+    }
+    for (int i = count - 1; i > 0; i--)
+    {
+        int j = check_rand(seed) % (i + 1);
+        node_id swap = ids[i];
+        ids[i] = ids[j];
+        ids[j] = swap;
+    }
+    // Deep chains and wide fans both show up: the parent is often the node just before
+    for (int i = 0; i < count; i++)
+    {
+        node_id child = ids[i];
+        node_id parent = check_rand(seed) % 2 ? child - 1 : NODE_ROOT + check_rand(seed) % (child - NODE_ROOT);
+        node_append_child(process, parent, child);
+        tree->children[parent][tree->child_count[parent]++] = child;
+    }
+    for (int i = 0; i < CHECK_MAX_NODES; i++)
+        tree->skip[i] = check_rand(seed) % 8 == 0;
+
+    node_id roots[] = {NODE_ROOT, NODE_ROOT + 1 + check_rand(seed) % count};
+    for (int r = 0; r < 2; r++)
+    {
+        static const char *names[] = {"preorder", "postorder", "preorder with skips"};
+        int walks[][2] = {{NODE_WALK_PREORDER, false}, {NODE_WALK_POSTORDER, false}, {NODE_WALK_PREORDER, true}};
+        for (int w = 0; w < 3; w++)
+        {
+            int index = check_walk(process, tree, roots[r], walks[w][0], walks[w][1]);
+            if (index >= 0)
+            {
+                fprintf(stderr, "%i nodes: %s from node %u differs from the recursive walk at step %i\n", count, names[w], roots[r], index);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int trees = 200;
+    unsigned int seed = CHECK_DEFAULT_SEED;
+    struct check_option options[] = {{"-n", "trees", CHECK_OPTION_INT, &trees}, {NULL}};
+    if (!check_parse_args(argc, argv, "node_check", options, &seed))
+    {
+        return 1;
+    }
+
+    struct compile_process *process = compile_process_create_for_source("check", "", 0, NULL, 0);
+    struct check_tree *tree = calloc(1, sizeof(struct check_tree));
+    int failed = 0;
+    for (int i = 0; i < trees && !failed; i++)
+    {
+        failed = check_tree(process, tree, &seed);
+    }
+    free(tree);
+    compile_process_free(process);
+    if (!failed)
+        printf("node_check: %i of %i trees walk like the recursive walk\n", trees, trees);
+    return failed;
+}
@@ -0,0 +1,227 @@
+// Checks the tree shapes the parser builds. Every case is a piece of source and
+// the top level nodes it has to produce, written as s-expressions. Operators
+// print as themselves, calls as "call", subscripts as "[]", type names as <...>.
+// Cases that must fail give the error message instead.
+#include "compiler.h"
+#include "helpers/buffer.h"
+
+struct parse_case
+{
+    const char *source;
+    const char *expected;
+};
+
+static const struct parse_case parse_cases[] = {
+    // Precedence and associativity
+    {"a + b * c", "(+ a (* b c))"},
+    {"a * b + c", "(+ (* a b) c)"},
+    {"a - b - c", "(- (- a b) c)"},
+    {"a / b % c * d", "(* (% (/ a b) c) d)"},
+    {"a << 1 + b", "(<< a (+ 1 b))"},
+    {"a < b == c < d", "(== (< a b) (< c d))"},
+    {"a & b ^ c | d", "(| (^ (& a b) c) d)"},
+    {"a || b && c", "(|| a (&& b c))"},
+    {"a && b || c && d", "(|| (&& a b) (&& c d))"},
+    {"a, b, c", "(, (, a b) c)"},
+    // Assignment and ?: are right associative
+    {"a = b = c", "(= a (= b c))"},
+    {"a += b -= c", "(+= a (-= b c))"},
+    {"a ? b : c ? d : e", "(?: a b (?: c d e))"},
+    {"a ? b ? c : d : e", "(?: a (?: b c d) e)"},
+    {"a = b ? c : d", "(= a (?: b c d))"},
+    {"a ? b, c : d", "(?: a (, b c) d)"},
+    {"a, b = c", "(, a (= b c))"},
+    // Casts against parenthesised expressions
+    {"(a)", "(() a)"},
+    {"(a + b) * c", "(* (() (+ a b)) c)"},
+    {"(int)x", "(cast <int> x)"},
+    {"(unsigned long *)p + 1", "(+ (cast <unsigned long *> p) 1)"},
+    {"(char)-x", "(cast <char> (- x))"},
+    {"(a)(b)", "(call (() a) b)"},
+    // sizeof
+    {"sizeof x", "(sizeof x)"},
+    {"sizeof x + 1", "(+ (sizeof x) 1)"},
+    {"sizeof (int)", "(sizeof <int>)"},
+    {"sizeof (struct abc *)", "(sizeof <struct abc *>)"},
+    {"sizeof (a)[0]", "(sizeof ([] (() a) 0))"},
+    {"sizeof a[0]", "(sizeof ([] a 0))"},
+    // Calls, subscripts and members
+    {"f()", "(call f)"},
+    {"f(a, b = c)", "(call f a (= b c))"},
+    {"f(a)(b)", "(call (call f a) b)"},
+    {"a[i][j]", "([] ([] a i) j)"},
+    {"a[i, j]", "([] a (, i j))"},
+    {"a.b->c", "(-> (. a b) c)"},
+    {"a->b[0].c(1)", "(call (. ([] (-> a b) 0) c) 1)"},
+    // Prefix and postfix ++ and --
+    {"++a", "(++ a)"},
+    {"--a", "(-- a)"},
+    {"a++", "(post++ a)"},
+    {"a--", "(post-- a)"},
+    {"-a++", "(- (post++ a))"},
+    {"*p++", "(* (post++ p))"},
+    {"++*p", "(++ (* p))"},
+    {"a++ + ++b", "(+ (post++ a) (++ b))"},
+    {"!~-x", "(! (~ (- x)))"},
+    {"&a.b", "(& (. a b))"},
+    // Statement headers are skipped at the top level
+    {"for (i = 0; i < n; i++) x++;", "(post++ x)"},
+    {"for(;;){}", ""},
+    {"while (a) b = c;", "(= b c)"},
+    {"if (f(x)) y(); else z;", "(call y) | z"},
+    {"switch (a) { }", ""},
+    // Bad top level expressions are dropped, parsing goes on after the failing token
+    {"a + ; b", "b"},
+    {"x.1 y", "y"},
+    // Declarations
+    {"int a = 1 + 2;", "(var a <int> (+ 1 2))"},
+    {"int x, ;", "error: Expected a variable name after ','"},
+    {"unsigned long z = 3, w = z * 2;", "(vars <unsigned long> (var z <> 3) (var w <> (* z 2)))"},
+    {"int *p, q, **r = 0;", "(vars <int> (var p <*>) (var q <>) (var r <* *> 0))"},
+    {"int a[10];", "(var a <int> (dim 10))"},
+    {"int a[2][] = {1, {2}}; b", "(var a <int> (dim 2) (dim)) | b"},
+    {"int (*fp)(void); x", "x"},
+    {"struct abc { int x; } s; y", "y"},
+    {"int main(int argc, char **argv) { return 0; }", "(function main <int> (var argc <int>) (var argv <char * *>)) | 0"},
+    {"int f(void);", "(function f <int> <void>)"},
+    {"int g(int, char *, ...);", "(function g <int> <int> <char *>)"},
+    {"int f(int a[], char *b);", "(function f <int> (var a <int> (dim)) (var b <char *>))"},
+    {"void k(int (*cb)(int), int x) {}", "(function k <void> (var x <int>))"},
+    {"int f(int a", "error: Unexpected end of file in a parameter list"},
+    {NULL, NULL}};
+
+static void parse_dump(struct buffer *out, struct compile_process *process, node_id id)
+{
+    struct node *node = node_at(process, id);
+    switch (node->type)
+    {
+    case NODE_TYPE_NUMBER:
+        buffer_printf(out, "%llu", node_number(process, id));
+        return;
+    case NODE_TYPE_IDENTIFIER:
+        buffer_printf(out, "%s", node_sval(process, id));
+        return;
+    case NODE_TYPE_STRING:
+        buffer_printf(out, "\"%s\"", node_sval(process, id));
+        return;
+    case NODE_TYPE_TYPENAME:
+        buffer_printf(out, "<");
+        for (int i = 0; i < node->flag; i++)
+        {
+            struct token token;
+            token_store_get(process->tokens, node->value + i, &token);
+            buffer_printf(out, i ? " %s" : "%s", token.type == TOKEN_TYPE_OPERATOR ? operator_str(token.op) : token.sval);
+        }
+        buffer_printf(out, ">");
+        return;
+    }
+
+    const char *name = "?";
+    switch (node->type)
+    {
+    case NODE_TYPE_EXPRESSION:
+        name = node->value == OPERATOR_LEFT_PAREN ? "call" : node->value == OPERATOR_LEFT_BRACKET ? "[]" : operator_str(node->value);
+        break;
+    case NODE_TYPE_UNARY:
+        if (node->flag & NODE_FLAG_SIZEOF)
+            name = "sizeof";
+        else if (node->flag & NODE_FLAG_POSTFIX)
+            name = node->value == OPERATOR_INCREMENT ? "post++" : "post--";
+        else
+            name = operator_str(node->value);
+        break;
+    case NODE_TYPE_TENARY:
+        name = "?:";
+        break;
+    case NODE_TYPE_CAST:
+        name = "cast";
+        break;
+    case NODE_TYPE_EXPRESSION_PARENTHESES:
+        name = "()";
+        break;
+    case NODE_TYPE_VARIABLE:
+        name = "var";
+        break;
+    case NODE_TYPE_VARIABLE_LIST:
+        name = "vars";
+        break;
+    case NODE_TYPE_FUNCTION:
+        name = "function";
+        break;
+    case NODE_TYPE_BRACKET:
+        name = "dim";
+        break;
+    }
+    buffer_printf(out, "(%s", name);
+    if (node->type == NODE_TYPE_VARIABLE || node->type == NODE_TYPE_FUNCTION)
+        buffer_printf(out, " %s", node_sval(process, id));
+    for (node_id child = node->first_child; child; child = node_at(process, child)->next_sibling)
+    {
+        buffer_printf(out, " ");
+        parse_dump(out, process, child);
+    }
+    buffer_printf(out, ")");
+}
+
+// The top level nodes separated by " | ", or the error without its position
+static void parse_source(struct buffer *out, const char *source)
+{
+    struct buffer *diagnostics = buffer_create();
+    struct compile_process *process = compile_process_create_for_source("check", source, strlen(source), NULL, 0);
+    process->diagnostics = diagnostics;
+    if (compile_process_run(process) != COMPILER_FILE_COMPILED_OK)
+    {
+        const char *msg = buffer_ptr(diagnostics);
+        size_t len = strcspn(msg, "\n");
+        const char *position = strstr(msg, " on line");
+        if (position && (size_t)(position - msg) < len)
+            len = position - msg;
+        buffer_printf(out, "error: %.*s", (int)len, msg);
+    }
+    else
+    {
+        for (node_id id = node_at(process, NODE_ROOT)->first_child; id; id = node_at(process, id)->next_sibling)
+        {
+            parse_dump(out, process, id);
+            if (node_at(process, id)->next_sibling)
+                buffer_printf(out, " | ");
+        }
+    }
+    compile_process_free(process);
+    buffer_free(diagnostics);
+}
+
+int main()
+{
+    int failed = 0;
+    int count = 0;
+    for (const struct parse_case *test = parse_cases; test->source; test++, count++)
+    {
+        struct buffer *out = buffer_create();
+        parse_source(out, test->source);
+        if (!S_EQ(buffer_ptr(out), test->expected))
+        {
+            fprintf(stderr, "%s\n  expected: %s\n  got:      %s\n", test->source, test->expected, (char *)buffer_ptr(out));
+            failed++;
+        }
+        buffer_free(out);
+    }
+
+    // Nesting limits stay errors at the top level
+    struct buffer *deep = buffer_create();
+    for (int i = 0; i < 2000; i++)
+        buffer_printf(deep, "(");
+    struct buffer *out = buffer_create();
+    parse_source(out, buffer_ptr(deep));
+    if (!S_EQ(buffer_ptr(out), "error: Expression is nested too deeply"))
+    {
+        fprintf(stderr, "%i nested '('\n  got: %s\n", 2000, (char *)buffer_ptr(out));
+        failed++;
+    }
+    buffer_free(out);
+    buffer_free(deep);
+    count++;
+
+    printf("parse_check: %i of %i cases parse to the expected tree\n", count - failed, count);
+    return failed ? 1 : 0;
+}
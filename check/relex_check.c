@@ -0,0 +1,221 @@
+// Randomised edit harness for lex_relex. Every corpus shape is lexed once,
+// then edited over and over at random places. After each edit the relexed
+// tokens must equal a full lex() of the edited source, read through the gap
+// relex leaves in the store or after lex_process_tokens closed it. The same edits are
+// replayed on a token store loaded from the .ptok cache, which has to carry
+// everything relex relies on.
+#include "compiler.h"
+#include "bench/corpus.h"
+#include "check/check.h"
+#include "helpers/buffer.h"
+#include "helpers/vector.h"
+#include <setjmp.h>
+#include <unistd.h>
+
+static struct lex_process_functions check_functions = {0};
+
+// A lexer over its own copy of the source, lexed from scratch or loaded from the cache
+struct check_lexer
+{
+    struct compile_process *cprocess;
+    struct lex_process *lexer;
+    struct buffer *diagnostics;
+};
+
+static void check_lexer_create(struct check_lexer *check, const char *src, size_t size)
+{
+    check->cprocess = compile_process_create_for_source("check", src, size, NULL, 0);
+    check->diagnostics = buffer_create();
+    check->cprocess->diagnostics = check->diagnostics;
+    check->lexer = lex_process_create(check->cprocess, &check_functions, NULL);
+    lex_process_set_source(check->lexer, src, size);
+}
+
+static void check_lexer_free(struct check_lexer *check)
+{
+    lex_process_free(check->lexer);
+    compile_process_free(check->cprocess);
+    buffer_free(check->diagnostics);
+}
+
+// Full lex, false when the source does not lex
+static bool check_lexer_lex(struct check_lexer *check)
+{
+    check->cprocess->error_jmp_set = true;
+    bool ok = setjmp(check->cprocess->error_jmp) == 0 && lex(check->lexer) == LEXICAL_ANALYSIS_ALL_OK;
+    check->cprocess->error_jmp_set = false;
+    return ok;
+}
+
+static bool check_lexer_load_cached(struct check_lexer *check, const char *cache_dir)
+{
+    struct compile_process *cprocess = check->cprocess;
+    cprocess->cache_dir = cache_dir;
+    if (tokcache_load(cprocess, tokcache_key(cprocess)) < 0)
+    {
+        return false;
+    }
+    token_store_free(check->lexer->tokens);
+    check->lexer->tokens = cprocess->tokens;
+    cprocess->tokens = NULL;
+    // tokcache_load registered the source as the only file
+    check->lexer->file = vector_count(cprocess->files);
+    return true;
+}
+
+// Index of the first token that differs, -1 when both stores hold the same tokens
+static int check_compare(struct token_store *a, struct token_store *b)
+{
+    int count = a->count < b->count ? a->count : b->count;
+    for (int i = 0; i < count; i++)
+    {
+        struct token x;
+        struct token y;
+        token_store_get(a, i, &x);
+        token_store_get(b, i, &y);
+        if (x.type != y.type || x.offset != y.offset || x.whitespace != y.whitespace || x.slen != y.slen || x.flags != y.flags ||
+            x.num.type != y.num.type || x.between_brackets.offset != y.between_brackets.offset || x.between_brackets.len != y.between_brackets.len)
+        {
+            return i;
+        }
+        switch (x.type)
+        {
+        case TOKEN_TYPE_IDENTIFIER:
+        case TOKEN_TYPE_STRING:
+        case TOKEN_TYPE_COMMENT:
+            if (memcmp(x.sval, y.sval, x.slen) != 0)
+                return i;
+            break;
+        case TOKEN_TYPE_KEYWORLD:
+        case TOKEN_TYPE_OPERATOR:
+            if (x.keyword != y.keyword)
+                return i;
+            break;
+        default:
+            if (x.llnum != y.llnum)
+                return i;
+        }
+    }
+    return a->count == b->count ? -1 : count;
+}
+
+// Text that changes how its neighbours lex: parens, quotes, comment markers, 0 before x
+static const char *check_inserts[] = {"", "", "a", "x", "b", "0", "1", " ", "\t", "\n", "(", ")", "((", "))", "\"", "'a'",
+                                      "/*", "*/", "//", "/", "*", ".", "..", "+", "=", "<", ">", "0x", "0b", "include", "#include <",
+                                      "int ", "abc_12", "\"str\"", "\\", ";", "{", "}", "1L", "2f"};
+
+static int check_shape(const char *shape, size_t size, int edits, unsigned int seed, const char *cache_dir)
+{
+    // The unedited corpus stays alive, the cached store's process still points at it
+    struct buffer *original = buffer_create();
+    corpus_generate(original, shape, size, seed);
+    struct buffer *source = original;
+
+    struct check_lexer relexed;
+    check_lexer_create(&relexed, buffer_ptr(source), source->len);
+    if (!check_lexer_lex(&relexed))
+    {
+        fprintf(stderr, "%s: the corpus does not lex\n", shape);
+        return 1;
+    }
+
+    // The cached copy starts from a .ptok written for the unedited source
+    relexed.cprocess->tokens = relexed.lexer->tokens;
+    relexed.cprocess->cache_dir = cache_dir;
+    tokcache_store(relexed.cprocess, tokcache_key(relexed.cprocess));
+    relexed.cprocess->tokens = NULL;
+    struct check_lexer cached;
+    check_lexer_create(&cached, buffer_ptr(source), source->len);
+    if (!check_lexer_load_cached(&cached, cache_dir))
+    {
+        fprintf(stderr, "%s: could not load the cached tokens\n", shape);
+        return 1;
+    }
+
+    int applied = 0;
+    int failed = 0;
+    for (int i = 0; i < edits && !failed; i++)
+    {
+        size_t start = check_rand(&seed) % (source->len + 1);
+        size_t end = start + check_rand(&seed) % 9;
+        if (end > (size_t)source->len)
+            end = source->len;
+        const char *text = check_inserts[check_rand(&seed) % (sizeof(check_inserts) / sizeof(check_inserts[0]))];
+        size_t len = strlen(text);
+
+        // Edits that break the source are skipped, the harness only compares tokens
+        struct buffer *edited = buffer_create();
+        buffer_write_n(edited, buffer_ptr(source), source->len);
+        buffer_splice(edited, start, end - start, text, len);
+        struct check_lexer full;
+        check_lexer_create(&full, buffer_ptr(edited), edited->len);
+        if (!check_lexer_lex(&full))
+        {
+            check_lexer_free(&full);
+            buffer_free(edited);
+            continue;
+        }
+
+        struct check_lexer *lexers[] = {&relexed, &cached};
+        for (int j = 0; j < 2 && !failed; j++)
+        {
+            // Mostly compared with the gaps still open, sometimes closed the way a parser would get them
+            int res = lex_relex(lexers[j]->lexer, start, end, text, len);
+            struct token_store *tokens = check_rand(&seed) % 8 ? lexers[j]->lexer->tokens : lex_process_tokens(lexers[j]->lexer);
+            int index = res == LEXICAL_ANALYSIS_ALL_OK ? check_compare(tokens, full.lexer->tokens) : 0;
+            if (index >= 0)
+            {
+                fprintf(stderr, "%s: edit %i [%zu, %zu) -> \"%s\" on the %s store differs from a full lex at token %i\n", shape, i, start, end, text,
+                        j ? "cached" : "lexed", index);
+                failed = 1;
+            }
+        }
+        check_lexer_free(&full);
+        // The lexers copied the source on their first edit, so the old text can go
+        if (source != original)
+            buffer_free(source);
+        source = edited;
+        applied++;
+    }
+
+    check_lexer_free(&relexed);
+    check_lexer_free(&cached);
+    if (source != original)
+        buffer_free(source);
+    buffer_free(original);
+    if (!failed)
+        printf("%-12s %i edits\n", shape, applied);
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    size_t size = 16 * 1024;
+    int edits = 300;
+    unsigned int seed = CHECK_DEFAULT_SEED;
+    struct check_option options[] = {{"-s", "size_kb", CHECK_OPTION_SIZE_KB, &size}, {"-e", "edits", CHECK_OPTION_INT, &edits}, {NULL}};
+    if (!check_parse_args(argc, argv, "relex_check", options, &seed))
+    {
+        return 1;
+    }
+
+    char cache_dir[] = "/tmp/relex_check.XXXXXX";
+    if (!mkdtemp(cache_dir))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    int failed = 0;
+    for (const char **shape = corpus_shapes; *shape; shape++)
+    {
+        failed += check_shape(*shape, size, edits, seed, cache_dir);
+    }
+
+    struct buffer *cleanup = buffer_create();
+    buffer_printf(cleanup, "rm -rf %s", cache_dir);
+    if (system(buffer_ptr(cleanup)) != 0)
+        fprintf(stderr, "Could not remove %s\n", cache_dir);
+    buffer_free(cleanup);
+    return failed ? 1 : 0;
+}
@@ -1,36 +1,106 @@
 #include "compiler.h"
+#include "helpers/buffer.h"
 
 struct lex_process_functions compiler_lex_functions = {
     .next_char = compile_process_next_char,
     .peek_char = compile_process_peek_char,
     .push_char = compile_process_push_char};
 
-int compile_file(const char *filename, const char *out_filename, int flags)
+static int compile_process_run_phases(struct compile_process *cprocess, struct lex_process *lexer)
 {
-    struct compile_process *cprocess = compile_process_create(filename, out_filename, flags);
-    if (!cprocess)
+    // 相同的源码和flags之前lex过的话直接用缓存里的token
+    trace_phase_begin(cprocess, COMPILE_PHASE_LEX);
+    uint64_t cache_key = cprocess->cache_dir ? tokcache_key(cprocess) : 0;
+    if (tokcache_load(cprocess, cache_key) < 0)
+    {
+        // Preform lexical analysis
+        if (lex(lexer) != LEXICAL_ANALYSIS_ALL_OK)
+        {
+            return COMPILER_FAILED_WITH_ERROR;
+        }
+        // tokens 交给 compile_process
+        cprocess->tokens = lexer->tokens;
+        lexer->tokens = NULL;
+        tokcache_store(cprocess, cache_key);
+    }
+    trace_phase_end(cprocess, COMPILE_PHASE_LEX);
+
+    TRACE(cprocess, TRACE_LEX, TRACE_LEVEL_INFO, "lexer end-------\n\n");
+    // Preform parsing
+    trace_phase_begin(cprocess, COMPILE_PHASE_PARSE);
+    if (parse(cprocess) != PARSE_ALL_OK)
+    {
         return COMPILER_FAILED_WITH_ERROR;
+    }
+    trace_phase_end(cprocess, COMPILE_PHASE_PARSE);
+    // Preform code generator
+
+    return COMPILER_FILE_COMPILED_OK;
+}
 
-    // Preform lexical analysis
+int compile_process_run(struct compile_process *cprocess)
+{
     struct lex_process *lexer = lex_process_create(cprocess, &compiler_lex_functions, NULL);
     if (!lexer)
     {
         return COMPILER_FAILED_WITH_ERROR;
     }
+    // lexer直接在mmap的源码上工作
+    lex_process_set_source(lexer, cprocess->ifile.data, cprocess->ifile.size);
 
-    if (lex(lexer) != LEXICAL_ANALYSIS_ALL_OK)
+    int res = COMPILER_FAILED_WITH_ERROR;
+    cprocess->error_jmp_set = true;
+    if (setjmp(cprocess->error_jmp) == 0)
     {
-        return COMPILER_FAILED_WITH_ERROR;
+        res = compile_process_run_phases(cprocess, lexer);
     }
-    cprocess->token_vec = lexer->token_vec;
+    cprocess->error_jmp_set = false;
 
-    printf("lexer end-------\n\n");
-    // Preform parsing
-    if (parse(cprocess) != PARSE_ALL_OK)
+    lex_process_free(lexer);
+    trace_flush(cprocess);
+    return res;
+}
+
+// 库的入口从环境变量读取trace和time report的设置
+static void compile_process_configure_from_env(struct compile_process *cprocess, uint64_t start_ns)
+{
+    trace_parse(getenv("PEACH_TRACE"), cprocess->trace_levels);
+    cprocess->time_report = getenv("PEACH_TIME_REPORT") != NULL;
+    // 输入在create里就已经读进来了
+    cprocess->phases[COMPILE_PHASE_READ].start_ns = start_ns;
+    trace_phase_end(cprocess, COMPILE_PHASE_READ);
+}
+
+static int compile_process_run_and_free(struct compile_process *cprocess)
+{
+    int res = compile_process_run(cprocess);
+    if (cprocess->time_report)
     {
-        return COMPILER_FAILED_WITH_ERROR;
+        struct buffer *report = buffer_create();
+        trace_time_report(report, cprocess->ifile.abs_path, cprocess->phases);
+        fwrite(buffer_ptr(report), 1, report->len, stderr);
+        buffer_free(report);
     }
-    // Preform code generator
+    compile_process_free(cprocess);
+    return res;
+}
 
-    return COMPILER_FILE_COMPILED_OK;
-};
\ No newline at end of file
+int compile_file(const char *filename, const char *out_filename, int flags)
+{
+    uint64_t start_ns = trace_now_ns();
+    struct compile_process *cprocess = compile_process_create(filename, out_filename, flags);
+    if (!cprocess)
+        return COMPILER_FAILED_WITH_ERROR;
+    compile_process_configure_from_env(cprocess, start_ns);
+    return compile_process_run_and_free(cprocess);
+};
+
+int compile_source(const char *name, const char *source, size_t size, const char *out_filename, int flags)
+{
+    uint64_t start_ns = trace_now_ns();
+    struct compile_process *cprocess = compile_process_create_for_source(name, source, size, out_filename, flags);
+    if (!cprocess)
+        return COMPILER_FAILED_WITH_ERROR;
+    compile_process_configure_from_env(cprocess, start_ns);
+    return compile_process_run_and_free(cprocess);
+}
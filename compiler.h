@@ -5,51 +5,16 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stddef.h>
 
 // macro's make life cleaner
 #define S_EQ(str, str2) \
     (str && str2 && (strcmp(str, str2) == 0))
 
-#define NUMERIC_CASE \
-    case '0':        \
-    case '1':        \
-    case '2':        \
-    case '3':        \
-    case '4':        \
-    case '5':        \
-    case '6':        \
-    case '7':        \
-    case '8':        \
-    case '9'
-
-#define OPERATOR_CASE_EXCLUDING_DIVISION \
-    case '+':                            \
-    case '-':                            \
-    case '*':                            \
-    case '<':                            \
-    case '>':                            \
-    case '^':                            \
-    case '%':                            \
-    case '!':                            \
-    case '=':                            \
-    case '~':                            \
-    case '|':                            \
-    case '&':                            \
-    case '(':                            \
-    case '[':                            \
-    case ',':                            \
-    case '.':                            \
-    case '?'
-
-#define SYMBOL_CASE \
-    case '{':       \
-    case '}':       \
-    case ':':       \
-    case ';':       \
-    case '#':       \
-    case '\\':      \
-    case ')':       \
-    case ']'
+// 常驻进程复用compile_process时, intern table超过这个数量就重建
+#define COMPILE_PROCESS_MAX_WARM_STRINGS (1024 * 1024)
 
 enum
 {
@@ -69,12 +34,128 @@ enum
     TOKEN_TYPE_NEWLINE
 };
 
+// 顺序与token.c中的keyword_spellings一致
+enum
+{
+    KEYWORD_NONE,
+    KEYWORD_UNSIGNED,
+    KEYWORD_SIGNED,
+    KEYWORD_CHAR,
+    KEYWORD_SHORT,
+    KEYWORD_INT,
+    KEYWORD_FLOAT,
+    KEYWORD_DOUBLE,
+    KEYWORD_LONG,
+    KEYWORD_VOID,
+    KEYWORD_STRUCT,
+    KEYWORD_UNION,
+    KEYWORD_STATIC,
+    KEYWORD_IGNORE_TYPECHECK,
+    KEYWORD_RETURN,
+    KEYWORD_INCLUDE,
+    KEYWORD_SIZEOF,
+    KEYWORD_IF,
+    KEYWORD_ELSE,
+    KEYWORD_WHILE,
+    KEYWORD_FOR,
+    KEYWORD_DO,
+    KEYWORD_BREAK,
+    KEYWORD_CONTINUE,
+    KEYWORD_SWITCH,
+    KEYWORD_CASE,
+    KEYWORD_DEFAULT,
+    KEYWORD_GOTO,
+    KEYWORD_TYPEDEF,
+    KEYWORD_CONST,
+    KEYWORD_EXTERN,
+    KEYWORD_RESTRICT,
+    KEYWORD_COUNT
+};
+
+// 顺序与token.c中的operator_spellings一致
+enum
+{
+    OPERATOR_NONE,
+    OPERATOR_PLUS,
+    OPERATOR_MINUS,
+    OPERATOR_STAR,
+    OPERATOR_SLASH,
+    OPERATOR_PERCENT,
+    OPERATOR_INCREMENT,
+    OPERATOR_DECREMENT,
+    OPERATOR_ASSIGN,
+    OPERATOR_ADD_ASSIGN,
+    OPERATOR_SUB_ASSIGN,
+    OPERATOR_MUL_ASSIGN,
+    OPERATOR_DIV_ASSIGN,
+    OPERATOR_MOD_ASSIGN,
+    OPERATOR_AND_ASSIGN,
+    OPERATOR_OR_ASSIGN,
+    OPERATOR_XOR_ASSIGN,
+    OPERATOR_SHL_ASSIGN,
+    OPERATOR_SHR_ASSIGN,
+    OPERATOR_EQ,
+    OPERATOR_NE,
+    OPERATOR_LT,
+    OPERATOR_GT,
+    OPERATOR_LE,
+    OPERATOR_GE,
+    OPERATOR_LOGICAL_AND,
+    OPERATOR_LOGICAL_OR,
+    OPERATOR_LOGICAL_NOT,
+    OPERATOR_BITWISE_AND,
+    OPERATOR_BITWISE_OR,
+    OPERATOR_BITWISE_XOR,
+    OPERATOR_BITWISE_NOT,
+    OPERATOR_SHL,
+    OPERATOR_SHR,
+    OPERATOR_ARROW,
+    OPERATOR_DOT,
+    OPERATOR_ELLIPSIS,
+    OPERATOR_QUESTION,
+    OPERATOR_COMMA,
+    OPERATOR_LEFT_PAREN,
+    OPERATOR_LEFT_BRACKET,
+    OPERATOR_COUNT
+};
+
+// trace的分类, 每个分类单独设置level
+enum
+{
+    TRACE_LEX,
+    TRACE_PARSE,
+    TRACE_NODE,
+    TRACE_CATEGORY_COUNT
+};
+
+// level越大输出越多, 0表示关闭
+enum
+{
+    TRACE_LEVEL_OFF,
+    // 每个阶段一两行
+    TRACE_LEVEL_INFO,
+    // 每个token/node一条
+    TRACE_LEVEL_DEBUG,
+    TRACE_LEVEL_MAX = TRACE_LEVEL_DEBUG
+};
+
+// -ftime-report分别计时的阶段
+enum
+{
+    COMPILE_PHASE_READ,
+    COMPILE_PHASE_LEX,
+    COMPILE_PHASE_PARSE,
+    COMPILE_PHASE_CODEGEN,
+    COMPILE_PHASE_COUNT
+};
+
 enum
 {
     LEXICAL_ANALYSIS_ALL_OK,
     LEXICAL_ANALYSIS_INPUT_ERROR
 };
 
+// 打印错误时由srcloc_resolve算出来
 struct pos
 {
     int line;
@@ -83,26 +164,29 @@ struct pos
     const char *filename;
 };
 
-struct node;
-struct compile_process
+// 源码中的一段 [offset, offset + len)
+struct span
 {
-    // 标记文件该如何编译
-    int flags;
-    struct pos pos;
-    // 记录input file
-    struct compile_process_input_file
-    {
-        FILE *fp;
-        const char *abs_path;
-    } ifile;
-    // A vector of tokens from lexical analysis
-    struct vector *token_vec;
+    uint32_t offset;
+    uint32_t len;
+};
 
-    struct vector *node_vec;
-    struct vector *node_tree_vec;
+// 32位的源码位置: 所有文件依次排在同一个位置空间里, srcloc = 文件的base + 字节偏移, 0表示没有位置
+typedef uint32_t srcloc;
 
-    // outfile
-    FILE *ofile;
+struct source_file
+{
+    const char *name;
+    const char *data;
+    size_t size;
+    // 文件在位置空间里的起点, 占[base, base + size]
+    srcloc base;
+    // lex_relex修改过的源码中间有一段[gap, gap + gap_len)不是源码, gap之后的字节在data + gap_len + 偏移
+    uint32_t gap;
+    uint32_t gap_len;
+    // 每一行开始的偏移, 第一次需要行号时才扫描
+    uint32_t *line_starts;
+    uint32_t line_count;
 };
 
 enum
@@ -117,7 +201,8 @@ struct token
 {
     int type;
     int flags;
-    struct pos pos;
+    // token开始的位置
+    srcloc loc;
 
     union
     {
@@ -135,11 +220,162 @@ struct token
         int type;
     } num;
 
+    // 之后的阶段只比较这些整数
+    union
+    {
+        // TOKEN_TYPE_KEYWORLD 的种类, KEYWORD_xxx
+        int keyword;
+        // TOKEN_TYPE_OPERATOR 的种类, OPERATOR_xxx
+        int op;
+    };
+
+    // sval的长度, comment的sval直接指向源码, 不以0结尾
+    size_t slen;
+
     //  与下一个token之间是否有空格，eg: * a -> operator token *和a之间
     bool whitespace;
 
-    // eg: {hello world}  {1+2+3} {}括号之间的string
-    const char *between_brackets;
+    // token在源码中开始的字节偏移, lex_relex用它找重新lex的起点
+    uint32_t offset;
+
+    // eg: (hello world)  (1+2+3) 最外层()之间的源码, offset为0表示不在括号里
+    // 括号里的token要等到')'出现才知道len
+    struct span between_brackets;
+};
+
+// token_store.value 最高位为1时, 剩下的位是token_store.wide的下标
+#define TOKEN_VALUE_WIDE 0x80000000u
+
+// token按列存放, parser向前看时只碰type/value/offset这几列, 其余字段放在cold里
+struct token_store
+{
+    int count;
+    int capacity;
+    // TOKEN_TYPE_xxx
+    uint8_t *type;
+    // keyword/operator的种类, identifier/string的intern id, symbol的字符, 数字的值
+    uint32_t *value;
+    // token在源码中开始的字节偏移
+    uint32_t *offset;
+    struct token_cold
+    {
+        struct span between_brackets;
+        uint32_t slen;
+        int flags;
+        uint8_t num_type;
+        bool whitespace;
+    } *cold;
+
+    // lex_relex在各列中间留一个gap, gap之后的tail个token放在各列的最后, 修改只移动gap附近的token
+    // tail为0时各列是连续的, 直接读各列之前先用lex_process_tokens合上gap
+    int tail;
+    // tail里的offset存成end - offset, between_brackets.offset存成end + 1 - offset
+    // end跟着源码长度变, gap之后的token不用一个个平移
+    uint32_t end;
+
+    // 放不进value的数字
+    unsigned long long *wide;
+    int wide_count;
+    int wide_capacity;
+    // 删掉的token空出来的wide位置串成链表, 存的是下一个空位置的下标 + 1, 0表示没有
+    uint32_t wide_free;
+    // 每次realloc分配的字节数的累加, 只增不减
+    size_t allocated;
+
+    // comment的sval是source + offset + 2, tail里的是tail_source + offset + 2
+    const char *source;
+    const char *tail_source;
+    // store里的token都来自同一个文件, loc = base + offset
+    srcloc base;
+    // identifier/string的id在这里取回字符串
+    struct intern_table *strings;
+};
+
+// 一个阶段的计时和计数, tokens/nodes是阶段结束时的总数, bytes是这个阶段新分配的
+struct compile_phase_time
+{
+    // CLOCK_MONOTONIC的纳秒
+    uint64_t start_ns;
+    uint64_t end_ns;
+    int tokens;
+    int nodes;
+    size_t bytes;
+    // 整个进程的峰值, 多线程编译时包含其他文件
+    long peak_rss_kb;
+    bool done;
+};
+
+struct node;
+struct compile_process
+{
+    // 标记文件该如何编译
+    int flags;
+    // 正在处理的位置, 报错时使用
+    srcloc loc;
+    // 记录input file
+    struct compile_process_input_file
+    {
+        const char *abs_path;
+        // 整个输入文件, 能mmap就mmap, 否则(管道/stdin)一次性read进内存
+        const char *data;
+        size_t size;
+        // compile_process_next_char 等函数的读指针
+        size_t offset;
+        bool mapped;
+        // 调用者给的内存里的源码, 不归我们释放
+        bool borrowed;
+    } ifile;
+    // tokens from lexical analysis
+    struct token_store *tokens;
+    // lex过的文件, 下标 + 1就是文件id
+    struct vector *files;
+
+    // 所有node, 见node.c
+    struct node_store *nodes;
+    // parser还没挂到树上的node, 是node_id的栈
+    struct vector *node_vec;
+
+    // token的字符串等都从这里分配, 编译结束时一次性释放
+    struct arena *arena;
+    // identifier/keyword/string的唯一副本, 相同拼写的指针相同, 可以直接用==比较
+    struct intern_table *strings;
+
+    // parser的状态
+    struct compile_process_parser
+    {
+        // 下一个要看的token的下标
+        int index;
+        // 最后一个读掉的token, 从tokens里取出的完整副本
+        struct token last_token;
+        // 表达式嵌套的深度, 防止递归把栈用完
+        int depth;
+        // 不为NULL时语法错误不报错, 直接跳到这里, 见parse_top_level_expression
+        jmp_buf *recover;
+    } parser;
+
+    // compiler_error 跳回 compile_file, 而不是退出整个进程
+    jmp_buf error_jmp;
+    bool error_jmp_set;
+
+    // outfile, 第一次compile_process_output时才打开
+    const char *out_filename;
+    FILE *ofile;
+
+    // 不为NULL时错误和警告写到这里而不是stderr, 多文件编译时按文件顺序输出
+    struct buffer *diagnostics;
+
+    // 不为NULL时lex的结果缓存在这个目录里, 见tokcache.c
+    const char *cache_dir;
+
+    // 每个trace分类打开到的level, 见trace.c
+    uint8_t trace_levels[TRACE_CATEGORY_COUNT];
+    // trace写到这里, 为NULL时第一次trace创建一个, compile_process_run结束时写到stdout
+    struct buffer *trace;
+    bool trace_owned;
+
+    // 为true时记录每个阶段的phases
+    bool time_report;
+    struct compile_phase_time phases[COMPILE_PHASE_COUNT];
 };
 
 // struct compile_process;
@@ -157,18 +393,45 @@ struct lex_process_functions
 
 struct lex_process
 {
-    struct pos pos;
+    // 正在lex的文件, source_file_add返回的id
+    int file;
     struct compile_process *compiler;
-    struct vector *token_vec;
+    struct token_store *tokens;
 
     // ((50))   later explain
     int current_expression_count;
-    // 括号buffer
-    struct buffer *parentheses_buffer;
+    // 最外层'('之后的源码偏移
+    uint32_t expression_start;
+    // 最外层括号里第一个token的下标, ')'出现时给它之后的token填上between_brackets.len
+    int expression_first_token;
     struct lex_process_functions *function;
 
+    // lexer直接在内存里的源码上移动指针, 见lex_process_set_source
+    struct lex_process_source
+    {
+        const char *start;
+        const char *cur;
+        const char *end;
+    } source;
+    // 通过function读进来的源码, 没有设置source时使用
+    struct buffer *source_buffer;
+    // lex_relex修改的源码副本, [gap, gap + gap_len)空着, 修改只移动gap附近的字节
+    // 有gap时source.start是data + gap_len, 只有gap之后的源码能直接读
+    struct lex_edit_source
+    {
+        char *data;
+        size_t capacity;
+        size_t gap;
+        size_t gap_len;
+    } edit_source;
+
     // 使用者知道而lex不知道的私人变量
     void *lex_private;
+
+    // read_next_token返回的token, push进tokens前暂存在这里
+    struct token tmp_token;
+    // 正在读的token在源码中开始的位置
+    const char *token_start;
 };
 
 enum
@@ -208,73 +471,361 @@ enum
     NODE_TYPE_UNION,
     NODE_TYPE_BRACKET,
     NODE_TYPE_CAST,
-    NODE_TYPE_BLANK
+    NODE_TYPE_BLANK,
+    NODE_TYPE_ROOT,
+    // cast和sizeof里的类型名, 还没有自己的表示, value是第一个token的下标, flag是token的数量
+    NODE_TYPE_TYPENAME
+};
+
+// struct node.flag
+enum
+{
+    // ++/--写在操作数后面
+    NODE_FLAG_POSTFIX = 0b00000001,
+    // sizeof不是运算符, value是OPERATOR_NONE
+    NODE_FLAG_SIZEOF = 0b00000010
 };
 
+// node在node_store.nodes里的下标, 0表示没有
+typedef uint32_t node_id;
+#define NODE_NONE 0
+// 整个文件的根, 顶层的node都是它的子节点
+#define NODE_ROOT 1
+
+// 24字节, 树的形状直接用下标表示, 遍历时不需要额外的vector
 struct node
 {
-    int type;
-    int flag;
-    struct pos pos;
+    uint16_t type;
+    uint16_t flag;
+    srcloc loc;
+
+    // owner/function不单独存, 沿着parent往上找
+    node_id parent;
+    node_id first_child;
+    node_id next_sibling;
+
+    // 字面量: identifier/string是intern id, number最高位为1时是node_store.wide的下标, 和token_store.value一样
+    // EXPRESSION/UNARY: 运算符OPERATOR_*, 子节点依次是操作数
+    //   函数调用是OPERATOR_LEFT_PAREN, 子节点是函数和各个参数; 下标是OPERATOR_LEFT_BRACKET
+    //   a.b/a->b的第二个子节点是identifier
+    // TENARY: 子节点是条件, 真, 假; CAST: 子节点是TYPENAME和操作数
+    // VARIABLE: 变量名的intern id, 子节点是TYPENAME, 数组每一维一个BRACKET, 然后是可能有的初始值
+    // BRACKET: 数组的一维, 子节点是长度, []没有子节点
+    // VARIABLE_LIST: int *a, b = 1; 子节点是共用的类型和各个VARIABLE, 每个VARIABLE的TYPENAME只有它自己的'*'
+    // FUNCTION: 函数名的intern id, 子节点是返回类型的TYPENAME和各个参数, 参数是VARIABLE, 没有名字时是TYPENAME
+    uint32_t value;
+};
 
-    struct node_binded
-    {
-        // 指向body node
-        struct node *owner;
-        // 指向该node所在的func
-        struct node *function;
-    } binded;
+// node按创建顺序放在一个数组里, 整体分配整体释放
+struct node_store
+{
+    struct node *nodes;
+    // 每个node最后一个子节点, 只在建树时用来O(1)地追加子节点
+    node_id *last_child;
+    int count;
+    int capacity;
+    unsigned long long *wide;
+    int wide_count;
+    int wide_capacity;
+    // 每次realloc分配的字节数的累加, 只增不减, node_store_clear也不清零
+    size_t allocated;
+};
 
-    // 字面量
-    union
-    {
-        char cval;
-        const char *sval;
-        unsigned int inum;
-        unsigned long lnum;
-        unsigned long llnum;
-    };
+enum
+{
+    // 先访问node再访问子节点
+    NODE_WALK_PREORDER,
+    // 子节点都访问完再访问node
+    NODE_WALK_POSTORDER
+};
+
+// node_mark记下的位置, node_rewind回到这里时丢掉之后创建的node
+struct node_mark
+{
+    // node_vec的长度
+    int stack;
+    int count;
+    int wide_count;
+};
+
+// 不用递归的遍历, 只靠parent/first_child/next_sibling, 见node_walk_begin
+struct node_walk
+{
+    struct node_store *store;
+    node_id root;
+    // 下一次node_walk_next返回的node
+    node_id next;
+    // 上一次返回的node
+    node_id current;
+    int order;
 };
 
 // compiler.c
 int compile_file(const char *filename, const char *out_filename, int flags);
+/**
+ * @brief 编译内存中的源码, name只用于报错信息, source在编译期间必须一直有效
+ */
+int compile_source(const char *name, const char *source, size_t size, const char *out_filename, int flags);
+/**
+ * @brief 对已经创建好的compile_process执行 lex, parse..., 不会释放process
+ */
+int compile_process_run(struct compile_process *cprocess);
 
 // cprocess.c
 void compiler_error(struct compile_process *cprocess, const char *msg, ...);
 void compiler_warning(struct compile_process *cprocess, const char *msg, ...);
 struct compile_process *compile_process_create(const char *filename, const char *out_filename, int flags);
+struct compile_process *compile_process_create_for_source(const char *name, const char *source, size_t size, const char *out_filename, int flags);
+struct compile_process *compile_process_create_empty();
+/**
+ * @brief 把compile_process恢复成刚创建时的样子, 保留intern table, arena和vector的内存以便复用
+ */
+void compile_process_reset(struct compile_process *process);
+/**
+ * @brief reset之后打开新的输入文件, 文件打不开或读不了时返回-1
+ */
+int compile_process_reopen(struct compile_process *process, const char *filename, const char *out_filename, int flags);
+void compile_process_free(struct compile_process *process);
+/**
+ * @brief 第一次调用时才创建输出文件, 没有输出文件时返回NULL
+ */
+FILE *compile_process_output(struct compile_process *process);
+const char *compile_process_intern(struct compile_process *process, const char *str, size_t len);
 
 char compile_process_next_char(struct lex_process *lexer);
 char compile_process_peek_char(struct lex_process *lexer);
 void compile_process_push_char(struct lex_process *lexer, char c);
 
+// srcloc.c
+/**
+ * @brief 登记一个文件, 返回文件id. 之后它的位置是 base + 字节偏移
+ */
+int source_file_add(struct compile_process *process, const char *name, const char *data, size_t size);
+/**
+ * @brief 文件内容被修改之后调用, 返回文件现在的id, 后面还有别的文件时变大的文件会得到新的id
+ * data里[gap, gap + gap_len)不是源码, 没有gap时gap_len为0
+ */
+int source_file_update(struct compile_process *process, int file, const char *data, size_t size, size_t gap, size_t gap_len);
+struct source_file *source_file_get(struct compile_process *process, int file);
+void source_files_clear(struct compile_process *process);
+/**
+ * @brief 算出loc的行号和列号, 只在打印错误时使用
+ */
+struct pos srcloc_resolve(struct compile_process *process, srcloc loc);
+
+// trace.c
+// 定义PEACH_RELEASE时trace的代码和参数都不会被编译进去
+#ifdef PEACH_RELEASE
+#define TRACE_ENABLED(process, category, level) 0
+#define TRACE(process, category, level, ...) ((void)0)
+#else
+#define TRACE_ENABLED(process, category, level) ((process)->trace_levels[category] >= (level))
+#define TRACE(process, category, level, ...)              \
+    do                                                    \
+    {                                                     \
+        if (TRACE_ENABLED(process, category, level))      \
+            trace_printf(process, __VA_ARGS__);           \
+    } while (0)
+#endif
+/**
+ * @brief 解析"lex:2,parse"这样的设置, 不写level就是TRACE_LEVEL_MAX, "all"表示所有分类. 格式不对返回-1
+ */
+int trace_parse(const char *spec, uint8_t levels[TRACE_CATEGORY_COUNT]);
+void trace_printf(struct compile_process *process, const char *fmt, ...);
+/**
+ * @brief process自己创建的trace buffer一次性写到stdout
+ */
+void trace_flush(struct compile_process *process);
+uint64_t trace_now_ns();
+/**
+ * @brief time_report为false时什么都不做
+ */
+void trace_phase_begin(struct compile_process *process, int phase);
+void trace_phase_end(struct compile_process *process, int phase);
+/**
+ * @brief -ftime-report的文字表格
+ */
+void trace_time_report(struct buffer *out, const char *filename, struct compile_phase_time *phases);
+/**
+ * @brief 写出Chrome trace_event格式的事件, 每个事件前面都带逗号, ts相对于origin_ns. 调用者负责外面的 {"traceEvents":[ ... ]}
+ */
+void trace_chrome_events(struct buffer *out, const char *filename, int tid, struct compile_phase_time *phases, uint64_t origin_ns);
+
+// tokcache.c
+/**
+ * @brief 源码内容和flags的hash, 作为.ptok缓存文件的名字
+ */
+uint64_t tokcache_key(struct compile_process *process);
+/**
+ * @brief 命中时从缓存文件恢复process->tokens并返回0, 没有命中返回-1
+ */
+int tokcache_load(struct compile_process *process, uint64_t key);
+/**
+ * @brief 把process->tokens写进缓存目录, 失败返回-1, 不影响编译
+ */
+int tokcache_store(struct compile_process *process, uint64_t key);
+
 // lex_process.c
 struct lex_process *lex_process_create(struct compile_process *compiler, struct lex_process_functions *function, void *lex_private);
 void lex_process_free(struct lex_process *lexer);
+void lex_process_set_source(struct lex_process *lexer, const char *data, size_t size);
+void lex_process_read_source(struct lex_process *lexer);
 void *lex_process_private(struct lex_process *lexer);
-struct vector *lex_process_tokens(struct lex_process *lexer);
+/**
+ * @brief 源码[start, end)换成text, 之后gap停在restart, lexer从restart开始往后的源码是连续的
+ */
+void lex_process_splice_source(struct lex_process *lexer, size_t start, size_t end, const char *text, size_t len, size_t restart);
+/**
+ * @brief 合上lex_relex在源码和token里留下的gap之后返回tokens
+ */
+struct token_store *lex_process_tokens(struct lex_process *lexer);
 
 // lexer.c
 int lex(struct lex_process *process);
+/**
+ * @brief 源码[start, end)被替换成text之后, 只重新lex受影响的部分并更新lexer->tokens
+ * 源码和token都在修改的地方留一个gap, 之后的token不用移动. 出错时只保留出错位置之前的token
+ */
+int lex_relex(struct lex_process *lexer, size_t start, size_t end, const char *text, size_t len);
 /**
  * @brief 从字符串中构造token
  */
 struct lex_process *token_build_for_string(struct compile_process *compiler, const char *str);
 
 // token.c
-bool token_is_keyword(struct token *token, const char *keyword);
+bool token_is_keyword(struct token *token, int keyword);
+/**
+ * @brief 按长度和首字母判断是否为keyword, 返回KEYWORD_xxx, 不是keyword时返回KEYWORD_NONE
+ */
+int keyword_classify(const char *str, size_t len);
+const char *keyword_str(int keyword);
+bool token_is_operator(struct token *token, int op);
+const char *operator_str(int op);
+/**
+ * @brief identifier 比较, name必须是compile_process_intern返回的指针
+ */
+bool token_is_identifier(struct token *token, const char *name);
 bool token_is_symbol(struct token *token, char c);
 bool token_is_nl_or_comment_or_newline_seperator(struct token *token);
 
+// tokstore.c
+struct token_store *token_store_create(struct intern_table *strings);
+void token_store_free(struct token_store *store);
+void token_store_reserve(struct token_store *store, int count);
+void token_store_push(struct token_store *store, struct token *token);
+void token_store_pop(struct token_store *store);
+/**
+ * @brief 第index个token在各列里的下标, tail里的token在各列的最后
+ */
+int token_store_slot(struct token_store *store, int index);
+/**
+ * @brief 第index个token在源码中开始的字节偏移
+ */
+uint32_t token_store_offset(struct token_store *store, int index);
+/**
+ * @brief 把第index个token的所有字段取出来放进token
+ */
+void token_store_get(struct token_store *store, int index, struct token *token);
+unsigned long long token_store_number(struct token_store *store, int index);
+/**
+ * @brief 把gap移到第index个token前面, 只搬动gap原来的位置和index之间的token
+ */
+void token_store_move_gap(struct token_store *store, int index);
+/**
+ * @brief 用src里的全部token替换store中[index, index + remove), src为NULL时只删除
+ * 删掉的token之后的源码平移了delta, gap留在index
+ */
+void token_store_splice(struct token_store *store, int index, int remove, struct token_store *src, ptrdiff_t delta);
+bool token_store_is_nl_or_comment_or_newline_seperator(struct token_store *store, int index);
+/**
+ * @brief store创建以来分配过的字节数, 不是现在占用的
+ */
+size_t token_store_bytes(struct token_store *store);
+
 // parser.c
 int parse(struct compile_process *process);
 
 // node.c
-void node_set_vector(struct vector *vec, struct vector *vec_root);
-void node_push(struct node *node);
-struct node *node_peek_or_null();
-struct node *node_peek();
-struct node *node_pop();
-struct node *node_create(struct node *_node);
+struct node_store *node_store_create();
+void node_store_free(struct node_store *store);
+/**
+ * @brief 删掉所有node, 只留下NODE_ROOT, 保留内存以便复用
+ */
+void node_store_clear(struct node_store *store);
+/**
+ * @brief store创建以来分配过的字节数, 不是现在占用的
+ */
+size_t node_store_bytes(struct node_store *store);
+/**
+ * @brief 除了NODE_ROOT以外node的数量
+ */
+int node_count(struct compile_process *process);
+/**
+ * @brief 返回的指针在下一次node_create之前有效
+ */
+struct node *node_at(struct compile_process *process, node_id id);
+void node_push(struct compile_process *process, node_id id);
+/**
+ * @brief 栈为空时返回NODE_NONE
+ */
+node_id node_peek_or_null(struct compile_process *process);
+node_id node_peek(struct compile_process *process);
+node_id node_pop(struct compile_process *process);
+/**
+ * @brief 复制node的type/flag/value, 位置取process->loc, 新node放到栈顶并返回它的id
+ */
+node_id node_create(struct compile_process *process, struct node *node);
+/**
+ * @brief 把child接到parent的子节点末尾, child不能已经有parent
+ */
+void node_append_child(struct compile_process *process, node_id parent, node_id child);
+void node_mark(struct compile_process *process, struct node_mark *mark);
+/**
+ * @brief 删掉mark之后创建的node和压栈的id, 不复制, 只检查mark之后创建的node
+ * mark之后只能把新node接到新node下面, 不能动mark之前的node, 动了会assert失败
+ */
+void node_rewind(struct compile_process *process, struct node_mark *mark);
+/**
+ * @brief number存进node.value的值, 放不下31位的存到wide里
+ */
+uint32_t node_number_value(struct compile_process *process, unsigned long long number);
+unsigned long long node_number(struct compile_process *process, node_id id);
+const char *node_sval(struct compile_process *process, node_id id);
+/**
+ * @brief 从root开始按order遍历root和它下面所有的node
+ * for (node_id id = node_walk_next(&walk); id; id = node_walk_next(&walk))
+ */
+void node_walk_begin(struct node_walk *walk, struct compile_process *process, node_id root, int order);
+/**
+ * @brief 返回下一个node, 遍历完时返回NODE_NONE
+ */
+node_id node_walk_next(struct node_walk *walk);
+/**
+ * @brief 先序遍历时不进入上一次返回的node的子节点
+ */
+void node_walk_skip_children(struct node_walk *walk);
+
+// driver.c
+struct driver_options;
+/**
+ * @brief 命令行驱动, 结果和诊断信息写进out/err而不是stdout/stderr, 返回进程退出码
+ * cwd和env是调用者的工作目录和环境变量, 为NULL时使用本进程的
+ */
+int driver_main(int argc, const char **argv, const char *cwd, const char **env, struct buffer *out, struct buffer *err);
+const char *driver_getenv(struct driver_options *options, const char *name);
+
+// server.c
+/**
+ * @brief PEACH_SOCKET环境变量, 默认为/tmp/peachc-<uid>.sock
+ */
+const char *server_default_socket_path();
+/**
+ * @brief 常驻编译服务, 每个连接运行一次driver_main, 不会返回除非socket创建失败
+ */
+int server_main(const char *socket_path);
+/**
+ * @brief 把参数, cwd和环境变量转发给server并输出结果, 连不上server时返回-1
+ */
+int client_main(const char *socket_path, int argc, const char **argv);
 
 #endif
\ No newline at end of file
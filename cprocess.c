@@ -1,79 +1,282 @@
 #include "compiler.h"
 #include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 #include "helpers/vector.h"
+#include "helpers/arena.h"
+#include "helpers/intern.h"
+#include "helpers/buffer.h"
+
+static void compiler_diagnostic(struct compile_process *cprocess, const char *msg, va_list args)
+{
+    struct pos pos = srcloc_resolve(cprocess, cprocess->loc);
+    if (cprocess->diagnostics)
+    {
+        buffer_vprintf(cprocess->diagnostics, msg, args);
+        buffer_printf(cprocess->diagnostics, " on line %i, on col %i in file %s\n", pos.line, pos.col, pos.filename);
+        return;
+    }
+    vfprintf(stderr, msg, args);
+    fprintf(stderr, " on line %i, on col %i in file %s\n", pos.line, pos.col, pos.filename);
+}
 
 void compiler_error(struct compile_process *cprocess, const char *msg, ...)
 {
     va_list args;
     va_start(args, msg);
-    vfprintf(stderr, msg, args);
+    compiler_diagnostic(cprocess, msg, args);
     va_end(args);
-    fprintf(stderr, " on line %i, on col %i in file %s\n", cprocess->pos.line, cprocess->pos.col, cprocess->pos.filename);
-    exit(-1);
+    if (!cprocess->error_jmp_set)
+    {
+        exit(-1);
+    }
+    // 回到 compile_process_run, 同一进程里的其他编译不受影响
+    longjmp(cprocess->error_jmp, 1);
 }
 
 void compiler_warning(struct compile_process *cprocess, const char *msg, ...)
 {
     va_list args;
     va_start(args, msg);
-    vfprintf(stderr, msg, args);
+    compiler_diagnostic(cprocess, msg, args);
     va_end(args);
-    fprintf(stderr, " on line %i, on col %i in file %s\n", cprocess->pos.line, cprocess->pos.col, cprocess->pos.filename);
 }
 
-struct compile_process *compile_process_create(const char *filename, const char *out_filename, int flags)
+// 管道/stdin等无法mmap的输入, 一次性read进内存
+static int compile_process_read_all(int fd, struct compile_process_input_file *ifile)
 {
-    FILE *infile = fopen(filename, "r");
-    if (!infile)
+    size_t msize = 64 * 1024;
+    size_t size = 0;
+    char *data = malloc(msize);
+    while (1)
     {
-        return NULL;
+        if (size == msize)
+        {
+            msize *= 2;
+            data = realloc(data, msize);
+        }
+        ssize_t res = read(fd, data + size, msize - size);
+        if (res < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            free(data);
+            return -1;
+        }
+        if (res == 0)
+            break;
+        size += res;
+    }
+
+    ifile->data = data;
+    ifile->size = size;
+    ifile->mapped = false;
+    return 0;
+}
+
+static int compile_process_load_input(const char *filename, struct compile_process_input_file *ifile)
+{
+    int fd = S_EQ(filename, "-") ? STDIN_FILENO : open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
     }
-    FILE *outfile = NULL;
-    if (out_filename)
+
+#ifndef _WIN32
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
     {
-        outfile = fopen(out_filename, "w");
-        if (!outfile)
-            return NULL;
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            madvise(data, st.st_size, MADV_SEQUENTIAL);
+            ifile->data = data;
+            ifile->size = st.st_size;
+            ifile->mapped = true;
+            close(fd);
+            return 0;
+        }
     }
+#endif
+
+    int res = compile_process_read_all(fd, ifile);
+    if (fd != STDIN_FILENO)
+        close(fd);
+    return res;
+}
 
+static void compile_process_unload_input(struct compile_process_input_file *ifile)
+{
+    if (ifile->borrowed)
+        return;
+#ifndef _WIN32
+    if (ifile->mapped)
+        munmap((void *)ifile->data, ifile->size);
+    else
+#endif
+        free((void *)ifile->data);
+}
+
+struct compile_process *compile_process_create_empty()
+{
     struct compile_process *process = calloc(1, sizeof(struct compile_process));
-    process->node_vec = vector_create(sizeof(struct node *));
-    process->node_tree_vec = vector_create(sizeof(struct node *));
+    process->nodes = node_store_create();
+    process->node_vec = vector_create(sizeof(node_id));
+    process->arena = arena_create();
+    process->strings = intern_table_create();
+    process->files = vector_create(sizeof(struct source_file));
+    return process;
+}
 
+// 不会失败, 输出文件等到第一次要写的时候再打开, 见compile_process_output
+static void compile_process_set_input(struct compile_process *process, struct compile_process_input_file *ifile, const char *out_filename, int flags)
+{
     process->flags = flags;
-    process->pos.line = 1;
-    process->pos.col = 1;
-    process->ifile.fp = infile;
-    process->ifile.abs_path = filename;
-    process->ofile = outfile;
+    process->ifile = *ifile;
+    process->out_filename = out_filename ? arena_strndup(process->arena, out_filename, strlen(out_filename)) : NULL;
+}
+
+FILE *compile_process_output(struct compile_process *process)
+{
+    if (!process->ofile && process->out_filename)
+    {
+        process->ofile = fopen(process->out_filename, "w");
+        if (!process->ofile)
+            compiler_error(process, "Could not open %s for writing", process->out_filename);
+    }
+    return process->ofile;
+}
+
+static struct compile_process *compile_process_create_for_input(struct compile_process_input_file *ifile, const char *out_filename, int flags)
+{
+    struct compile_process *process = compile_process_create_empty();
+    compile_process_set_input(process, ifile, out_filename, flags);
     return process;
 }
 
-char compile_process_next_char(struct lex_process *lexer)
+struct compile_process *compile_process_create(const char *filename, const char *out_filename, int flags)
+{
+    struct compile_process_input_file ifile = {.abs_path = filename};
+    if (compile_process_load_input(filename, &ifile) < 0)
+    {
+        return NULL;
+    }
+
+    return compile_process_create_for_input(&ifile, out_filename, flags);
+}
+
+struct compile_process *compile_process_create_for_source(const char *name, const char *source, size_t size, const char *out_filename, int flags)
 {
-    struct compile_process *compiler = lexer->compiler;
-    compiler->pos.col += 1;
+    struct compile_process_input_file ifile = {.abs_path = name, .data = source, .size = size, .borrowed = true};
+    return compile_process_create_for_input(&ifile, out_filename, flags);
+}
+
+void compile_process_reset(struct compile_process *process)
+{
+    compile_process_unload_input(&process->ifile);
+    memset(&process->ifile, 0, sizeof(process->ifile));
 
-    char c = getc(compiler->ifile.fp);
-    if (c == '\n')
+    if (process->ofile)
+        fclose(process->ofile);
+    process->ofile = NULL;
+    process->out_filename = NULL;
+    if (process->tokens)
+        token_store_free(process->tokens);
+    process->tokens = NULL;
+
+    node_store_clear(process->nodes);
+    vector_clear(process->node_vec);
+    source_files_clear(process);
+    arena_reset(process->arena);
+    // 防止常驻进程里intern table无限增长
+    if (intern_count(process->strings) > COMPILE_PROCESS_MAX_WARM_STRINGS)
     {
-        compiler->pos.line += 1;
-        compiler->pos.col = 1;
+        intern_table_free(process->strings);
+        process->strings = intern_table_create();
     }
-    return c;
+
+    memset(&process->parser, 0, sizeof(process->parser));
+    process->diagnostics = NULL;
+    process->cache_dir = NULL;
+    if (process->trace_owned)
+        buffer_free(process->trace);
+    process->trace = NULL;
+    process->trace_owned = false;
+    memset(process->trace_levels, 0, sizeof(process->trace_levels));
+    process->time_report = false;
+    memset(process->phases, 0, sizeof(process->phases));
+    process->flags = 0;
+    process->loc = 0;
+}
+
+int compile_process_reopen(struct compile_process *process, const char *filename, const char *out_filename, int flags)
+{
+    compile_process_reset(process);
+
+    struct compile_process_input_file ifile = {.abs_path = filename};
+    if (compile_process_load_input(filename, &ifile) < 0)
+    {
+        return -1;
+    }
+    compile_process_set_input(process, &ifile, out_filename, flags);
+    return 0;
+}
+
+void compile_process_free(struct compile_process *process)
+{
+    compile_process_unload_input(&process->ifile);
+
+    if (process->ofile)
+        fclose(process->ofile);
+    if (process->tokens)
+        token_store_free(process->tokens);
+    node_store_free(process->nodes);
+    vector_free(process->node_vec);
+    source_files_clear(process);
+    vector_free(process->files);
+    arena_free(process->arena);
+    intern_table_free(process->strings);
+    if (process->trace_owned)
+        buffer_free(process->trace);
+    free(process);
+}
+
+const char *compile_process_intern(struct compile_process *process, const char *str, size_t len)
+{
+    return intern(process->strings, str, len);
+}
+
+char compile_process_next_char(struct lex_process *lexer)
+{
+    struct compile_process_input_file *ifile = &lexer->compiler->ifile;
+    if (ifile->offset >= ifile->size)
+    {
+        return EOF;
+    }
+    return ifile->data[ifile->offset++];
 };
 
 char compile_process_peek_char(struct lex_process *lexer)
 {
-    struct compile_process *compiler = lexer->compiler;
-    char c = getc(compiler->ifile.fp);
-    ungetc(c, compiler->ifile.fp);
-    return c;
+    struct compile_process_input_file *ifile = &lexer->compiler->ifile;
+    if (ifile->offset >= ifile->size)
+    {
+        return EOF;
+    }
+    return ifile->data[ifile->offset];
 };
 
 void compile_process_push_char(struct lex_process *lexer, char c)
 {
-    struct compile_process *compiler = lexer->compiler;
-    ungetc(c, compiler->ifile.fp);
+    struct compile_process_input_file *ifile = &lexer->compiler->ifile;
+    // 只会push回刚读出来的字符, 不需要看c
+    (void)c;
+    if (ifile->offset > 0)
+        ifile->offset--;
     return;
 };
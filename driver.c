@@ -0,0 +1,434 @@
+#include "compiler.h"
+#include <sys/stat.h>
+#include <pthread.h>
+#include "helpers/vector.h"
+#include "helpers/buffer.h"
+#include "helpers/arena.h"
+#include "helpers/threadpool.h"
+
+struct compile_job
+{
+    const char *filename;
+    const char *out_filename;
+    // Directory for .ptok token caches, NULL when caching is off
+    const char *cache_dir;
+    // Bigger files are scheduled first
+    off_t size;
+    int res;
+    struct buffer *diagnostics;
+    // Trace output, written to out in the same order as the diagnostics
+    struct buffer *trace;
+    const uint8_t *trace_levels;
+    // Copied out of the compile process before it goes back to the pool
+    bool time_report;
+    struct compile_phase_time phases[COMPILE_PHASE_COUNT];
+    // Worker that ran the job, becomes the tid in the Chrome trace
+    pthread_t thread;
+};
+
+struct driver_options
+{
+    int threads;
+    const char *out_filename;
+    // Relative paths are resolved against this directory, NULL for our own cwd
+    const char *cwd;
+    // NULL terminated "NAME=value" list, NULL for our own environment
+    const char **env;
+    // Vector of const char*
+    struct vector *inputs;
+    // Strings made while parsing the arguments, freed once the run is over
+    struct arena *arena;
+    struct buffer *err;
+    // --trace, overrides PEACH_TRACE
+    const char *trace_spec;
+    uint8_t trace_levels[TRACE_CATEGORY_COUNT];
+    // -ftime-report writes a table per file to err, -ftime-trace=file writes Chrome trace_event JSON
+    bool time_report;
+    const char *time_trace_filename;
+    bool bad_usage;
+};
+
+// Idle compile processes, a resident server reuses them between requests
+// so their intern tables, arenas and vectors stay warm. Lexed token stores
+// are not kept here: there is no #include handling yet, so no header is
+// lexed twice. Unchanged inputs are served from the .ptok files under
+// PEACH_CACHE_DIR instead. Once headers exist, their stores belong in this
+// pool keyed by path and mtime.
+static pthread_mutex_t driver_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct vector *driver_pool = NULL;
+
+static struct compile_process *driver_acquire_process()
+{
+    struct compile_process *process = NULL;
+    pthread_mutex_lock(&driver_pool_lock);
+    if (driver_pool && !vector_empty(driver_pool))
+    {
+        process = vector_back_ptr(driver_pool);
+        vector_pop(driver_pool);
+    }
+    pthread_mutex_unlock(&driver_pool_lock);
+
+    if (!process)
+    {
+        process = compile_process_create_empty();
+    }
+    return process;
+}
+
+static void driver_release_process(struct compile_process *process)
+{
+    compile_process_reset(process);
+    pthread_mutex_lock(&driver_pool_lock);
+    if (!driver_pool)
+    {
+        driver_pool = vector_create(sizeof(struct compile_process *));
+    }
+    vector_push(driver_pool, &process);
+    pthread_mutex_unlock(&driver_pool_lock);
+}
+
+const char *driver_getenv(struct driver_options *options, const char *name)
+{
+    if (!options->env)
+    {
+        return getenv(name);
+    }
+
+    size_t len = strlen(name);
+    for (const char **env = options->env; *env; env++)
+    {
+        if (strncmp(*env, name, len) == 0 && (*env)[len] == '=')
+        {
+            return *env + len + 1;
+        }
+    }
+    return NULL;
+}
+
+static const char *driver_path(struct driver_options *options, const char *path)
+{
+    if (!options->cwd || path[0] == '/' || S_EQ(path, "-"))
+    {
+        return path;
+    }
+
+    size_t cwd_len = strlen(options->cwd);
+    size_t path_len = strlen(path);
+    char *full = arena_alloc_aligned(options->arena, cwd_len + path_len + 2, 1);
+    memcpy(full, options->cwd, cwd_len);
+    full[cwd_len] = '/';
+    memcpy(full + cwd_len + 1, path, path_len + 1);
+    return full;
+}
+
+static void usage(struct driver_options *options)
+{
+    buffer_printf(options->err, "usage: main [-j threads] [-o output] [--trace=lex:2,parse,node]\n"
+                                "            [-ftime-report] [-ftime-trace=file.json] [@response_file] files...\n"
+                                "       main --server [socket]\n"
+                                "       main --client [arguments...]\n");
+    options->bad_usage = true;
+}
+
+static void compile_job_run(void *arg)
+{
+    struct compile_job *job = arg;
+    struct compile_process *cprocess = driver_acquire_process();
+    job->thread = pthread_self();
+    uint64_t start_ns = trace_now_ns();
+    if (compile_process_reopen(cprocess, job->filename, job->out_filename, 0) < 0)
+    {
+        buffer_printf(job->diagnostics, "Could not open %s\n", job->filename);
+        job->res = COMPILER_FAILED_WITH_ERROR;
+        driver_release_process(cprocess);
+        return;
+    }
+
+    cprocess->diagnostics = job->diagnostics;
+    cprocess->cache_dir = job->cache_dir;
+    cprocess->trace = job->trace;
+    memcpy(cprocess->trace_levels, job->trace_levels, sizeof(cprocess->trace_levels));
+    cprocess->time_report = job->time_report;
+    // reopen resets the process, so the read phase is closed after the fact
+    cprocess->phases[COMPILE_PHASE_READ].start_ns = start_ns;
+    trace_phase_end(cprocess, COMPILE_PHASE_READ);
+    job->res = compile_process_run(cprocess);
+    memcpy(job->phases, cprocess->phases, sizeof(job->phases));
+    driver_release_process(cprocess);
+}
+
+static int compile_job_compare_size(const void *a, const void *b)
+{
+    const struct compile_job *job_a = *(const struct compile_job **)a;
+    const struct compile_job *job_b = *(const struct compile_job **)b;
+    return (job_a->size < job_b->size) - (job_a->size > job_b->size);
+}
+
+// test.c -> test, everything else gets .out appended so we never overwrite an input
+static const char *driver_out_filename(struct driver_options *options, const char *filename)
+{
+    size_t len = strlen(filename);
+    if (len > 2 && S_EQ(filename + len - 2, ".c"))
+    {
+        return arena_strndup(options->arena, filename, len - 2);
+    }
+
+    char *out = arena_alloc_aligned(options->arena, len + 5, 1);
+    memcpy(out, filename, len);
+    memcpy(out + len, ".out", 5);
+    return out;
+}
+
+static void driver_parse_args(struct driver_options *options, int argc, const char **argv);
+
+// Response files hold further arguments separated by whitespace
+static void driver_read_response_file(struct driver_options *options, const char *filename)
+{
+    FILE *fp = fopen(driver_path(options, filename), "r");
+    if (!fp)
+    {
+        buffer_printf(options->err, "Could not open response file %s\n", filename);
+        options->bad_usage = true;
+        return;
+    }
+
+    struct vector *args = vector_create(sizeof(const char *));
+    struct buffer *arg = buffer_create();
+    for (int c = fgetc(fp);; c = fgetc(fp))
+    {
+        if (c == EOF || c == ' ' || c == '\t' || c == '\n' || c == '\r')
+        {
+            if (arg->len)
+            {
+                const char *str = arena_strndup(options->arena, buffer_ptr(arg), arg->len);
+                vector_push(args, &str);
+                arg->len = 0;
+            }
+            if (c == EOF)
+                break;
+            continue;
+        }
+        buffer_write(arg, c);
+    }
+    buffer_free(arg);
+    fclose(fp);
+
+    driver_parse_args(options, vector_count(args), vector_data_ptr(args));
+    vector_free(args);
+}
+
+static void driver_parse_args(struct driver_options *options, int argc, const char **argv)
+{
+    for (int i = 0; i < argc && !options->bad_usage; i++)
+    {
+        const char *arg = argv[i];
+        if (S_EQ(arg, "-j") || S_EQ(arg, "-o"))
+        {
+            if (i + 1 >= argc)
+            {
+                usage(options);
+                return;
+            }
+            if (arg[1] == 'j')
+                options->threads = atoi(argv[++i]);
+            else
+                options->out_filename = driver_path(options, argv[++i]);
+        }
+        else if (strncmp(arg, "-j", 2) == 0)
+        {
+            options->threads = atoi(arg + 2);
+        }
+        else if (S_EQ(arg, "-ftime-report"))
+        {
+            options->time_report = true;
+        }
+        else if (strncmp(arg, "-ftime-trace=", 13) == 0 && arg[13])
+        {
+            options->time_trace_filename = driver_path(options, arg + 13);
+        }
+        else if (strncmp(arg, "--trace=", 8) == 0)
+        {
+            options->trace_spec = arg + 8;
+        }
+        else if (arg[0] == '@')
+        {
+            driver_read_response_file(options, arg + 1);
+        }
+        else if (arg[0] == '-' && arg[1] != 0x00)
+        {
+            usage(options);
+        }
+        else
+        {
+            const char *input = driver_path(options, arg);
+            vector_push(options->inputs, &input);
+        }
+    }
+}
+
+// Chrome trace_event JSON, load it in chrome://tracing or Perfetto to see every worker's files and phases
+static void driver_write_time_trace(struct driver_options *options, struct compile_job *jobs, int total)
+{
+    // The earliest event starts at 0, the workers become the threads in order of first use
+    uint64_t origin_ns = UINT64_MAX;
+    for (int i = 0; i < total; i++)
+    {
+        struct compile_phase_time *read = &jobs[i].phases[COMPILE_PHASE_READ];
+        if (read->done && read->start_ns < origin_ns)
+            origin_ns = read->start_ns;
+    }
+    pthread_t *threads = calloc(sizeof(pthread_t), total);
+    int thread_count = 0;
+
+    struct buffer *json = buffer_create();
+    buffer_printf(json, "{\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"peach\"}}");
+    for (int i = 0; i < total; i++)
+    {
+        int tid = 0;
+        while (tid < thread_count && !pthread_equal(threads[tid], jobs[i].thread))
+            tid++;
+        if (tid == thread_count)
+        {
+            threads[thread_count++] = jobs[i].thread;
+            buffer_printf(json, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"args\":{\"name\":\"worker %i\"}}", tid, tid);
+        }
+        trace_chrome_events(json, jobs[i].filename, tid, jobs[i].phases, origin_ns);
+    }
+    buffer_printf(json, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    free(threads);
+
+    FILE *fp = fopen(options->time_trace_filename, "w");
+    if (!fp || fwrite(buffer_ptr(json), 1, json->len, fp) != (size_t)json->len)
+        buffer_printf(options->err, "Could not write %s\n", options->time_trace_filename);
+    if (fp)
+        fclose(fp);
+    buffer_free(json);
+}
+
+static int driver_compile(struct driver_options *options, struct buffer *out)
+{
+    int total = vector_count(options->inputs);
+    if (total == 0)
+    {
+        // No inputs keeps the old behaviour
+        const char *input = driver_path(options, "./test.c");
+        vector_push(options->inputs, &input);
+        options->out_filename = driver_path(options, "./test");
+        total = 1;
+    }
+    if (options->out_filename && total > 1)
+    {
+        // Every job would write the same file
+        buffer_printf(options->err, "-o can only be used with a single input\n");
+        usage(options);
+        return 1;
+    }
+    if (options->threads < 1)
+    {
+        usage(options);
+        return 1;
+    }
+
+    const char *trace_spec = options->trace_spec ? options->trace_spec : driver_getenv(options, "PEACH_TRACE");
+    if (trace_parse(trace_spec, options->trace_levels) < 0)
+    {
+        buffer_printf(options->err, "Bad trace setting %s\n", trace_spec);
+        usage(options);
+        return 1;
+    }
+
+    const char *cache_dir = driver_getenv(options, "PEACH_CACHE_DIR");
+    if (cache_dir && cache_dir[0])
+        cache_dir = driver_path(options, cache_dir);
+    else
+        cache_dir = NULL;
+
+    struct compile_job *jobs = calloc(sizeof(struct compile_job), total);
+    struct compile_job **schedule = calloc(sizeof(struct compile_job *), total);
+    for (int i = 0; i < total; i++)
+    {
+        struct compile_job *job = &jobs[i];
+        job->filename = *(const char **)vector_at(options->inputs, i);
+        job->out_filename = options->out_filename ? options->out_filename : driver_out_filename(options, job->filename);
+        job->diagnostics = buffer_create();
+        job->cache_dir = cache_dir;
+        job->trace = buffer_create();
+        job->trace_levels = options->trace_levels;
+        job->time_report = options->time_report || options->time_trace_filename;
+        struct stat st;
+        job->size = stat(job->filename, &st) == 0 ? st.st_size : 0;
+        schedule[i] = job;
+    }
+    qsort(schedule, total, sizeof(struct compile_job *), compile_job_compare_size);
+
+    struct threadpool *pool = threadpool_create(options->threads < total ? options->threads : total);
+    for (int i = 0; i < total; i++)
+    {
+        threadpool_submit(pool, compile_job_run, schedule[i]);
+    }
+    threadpool_run(pool);
+    threadpool_free(pool);
+
+    // Diagnostics are reported in the order the files were given, not the order they finished
+    int failed = 0;
+    for (int i = 0; i < total; i++)
+    {
+        struct compile_job *job = &jobs[i];
+        buffer_append(options->err, job->diagnostics);
+        buffer_free(job->diagnostics);
+        buffer_append(out, job->trace);
+        buffer_free(job->trace);
+        if (job->res != COMPILER_FILE_COMPILED_OK)
+            failed++;
+
+        if (total > 1)
+        {
+            if (job->res != COMPILER_FILE_COMPILED_OK)
+                buffer_printf(out, "Compile failed: %s\n", job->filename);
+            continue;
+        }
+
+        if (job->res == COMPILER_FILE_COMPILED_OK)
+            buffer_printf(out, "Everything compiled OK\n");
+        else if (job->res == COMPILER_FAILED_WITH_ERROR)
+            buffer_printf(out, "Compile failed\n");
+        else
+            buffer_printf(out, "Unknown response for compile file\n");
+    }
+    if (total > 1)
+        buffer_printf(out, "%i of %i files compiled OK\n", total - failed, total);
+
+    if (options->time_report)
+    {
+        for (int i = 0; i < total; i++)
+            trace_time_report(options->err, jobs[i].filename, jobs[i].phases);
+    }
+    if (options->time_trace_filename)
+        driver_write_time_trace(options, jobs, total);
+
+    free(schedule);
+    free(jobs);
+    return failed ? 1 : 0;
+}
+
+int driver_main(int argc, const char **argv, const char *cwd, const char **env, struct buffer *out, struct buffer *err)
+{
+    struct driver_options options = {
+        .threads = 1,
+        .cwd = cwd,
+        .env = env,
+        .inputs = vector_create(sizeof(const char *)),
+        .arena = arena_create(),
+        .err = err};
+    driver_parse_args(&options, argc, argv);
+
+    int res = 1;
+    if (!options.bad_usage)
+    {
+        res = driver_compile(&options, out);
+    }
+
+    vector_free(options.inputs);
+    arena_free(options.arena);
+    return res;
+}
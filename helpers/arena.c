@@ -0,0 +1,95 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static struct arena_block* arena_block_create(struct arena* arena, size_t size)
+{
+    if (size < ARENA_BLOCK_SIZE)
+    {
+        size = ARENA_BLOCK_SIZE;
+    }
+
+    struct arena_block* block = malloc(sizeof(struct arena_block) + size);
+    assert(block);
+    block->size = size;
+    block->used = 0;
+    block->next = arena->head;
+    arena->head = block;
+    arena->reserved += size;
+    return block;
+}
+
+struct arena* arena_create()
+{
+    struct arena* arena = calloc(sizeof(struct arena), 1);
+    return arena;
+}
+
+void* arena_alloc_aligned(struct arena* arena, size_t size, size_t align)
+{
+    struct arena_block* block = arena->head;
+    size_t offset = 0;
+    if (block)
+    {
+        offset = (block->used + align - 1) & ~(align - 1);
+    }
+
+    if (!block || offset + size > block->size)
+    {
+        // Worst case we need align-1 bytes of padding in the new block
+        block = arena_block_create(arena, size + align - 1);
+        offset = ((uintptr_t)block->data + align - 1) & ~(align - 1);
+        offset -= (uintptr_t)block->data;
+    }
+
+    block->used = offset + size;
+    arena->allocated += size;
+    return block->data + offset;
+}
+
+void* arena_alloc(struct arena* arena, size_t size)
+{
+    return arena_alloc_aligned(arena, size, ARENA_ALIGNMENT);
+}
+
+char* arena_strndup(struct arena* arena, const char* str, size_t len)
+{
+    char* copy = arena_alloc_aligned(arena, len + 1, 1);
+    memcpy(copy, str, len);
+    copy[len] = 0x00;
+    return copy;
+}
+
+void arena_reset(struct arena* arena)
+{
+    struct arena_block* block = arena->head;
+    if (!block)
+    {
+        return;
+    }
+
+    struct arena_block* next = block->next;
+    while (next)
+    {
+        struct arena_block* tmp = next->next;
+        arena->reserved -= next->size;
+        free(next);
+        next = tmp;
+    }
+    block->next = NULL;
+    block->used = 0;
+    arena->allocated = 0;
+}
+
+void arena_free(struct arena* arena)
+{
+    struct arena_block* block = arena->head;
+    while (block)
+    {
+        struct arena_block* next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
@@ -0,0 +1,51 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Every block holds at least this many bytes, larger requests get a block of their own
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGNMENT 8
+
+struct arena_block
+{
+    struct arena_block* next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+/**
+ * A bump pointer allocator, memory handed out is only released all at once
+ * by arena_reset or arena_free
+ */
+struct arena
+{
+    // The block we currently carve from, older blocks follow through next
+    struct arena_block* head;
+    // Bytes handed out and bytes reserved from the system
+    size_t allocated;
+    size_t reserved;
+};
+
+struct arena* arena_create();
+
+/**
+ * Allocates size bytes aligned to ARENA_ALIGNMENT
+ */
+void* arena_alloc(struct arena* arena, size_t size);
+void* arena_alloc_aligned(struct arena* arena, size_t size, size_t align);
+
+/**
+ * Copies len bytes of str into the arena and terminates them with a NULL byte
+ */
+char* arena_strndup(struct arena* arena, const char* str, size_t len);
+
+/**
+ * Releases everything allocated so far but keeps the most recent block for reuse
+ */
+void arena_reset(struct arena* arena);
+void arena_free(struct arena* arena);
+
+#endif
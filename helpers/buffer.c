@@ -1,56 +1,97 @@
 #include "buffer.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdarg.h>
+#include <assert.h>
+#include <limits.h>
 
 struct buffer* buffer_create()
 {
     struct buffer* buf = calloc(sizeof(struct buffer), 1);
-    buf->data = calloc(BUFFER_REALLOC_AMOUNT, 1);
+    buf->data = buf->inline_data;
     buf->len = 0;
-    buf->msize = BUFFER_REALLOC_AMOUNT;
+    buf->msize = BUFFER_INLINE_SIZE;
     return buf;
 }
 
+static void buffer_resize(struct buffer* buffer, size_t msize)
+{
+    if (buffer->data == buffer->inline_data)
+    {
+        char* data = malloc(msize);
+        memcpy(data, buffer->inline_data, buffer->len + 1);
+        buffer->data = data;
+    }
+    else
+    {
+        buffer->data = realloc(buffer->data, msize);
+    }
+    assert(buffer->data);
+    // len and msize are ints
+    assert(msize <= INT_MAX);
+    buffer->msize = msize;
+}
+
 void buffer_extend(struct buffer* buffer, size_t size)
 {
-    buffer->data = realloc(buffer->data, buffer->msize+size);
-    buffer->msize+=size;
+    buffer_resize(buffer, buffer->msize + size);
 }
 
 void buffer_need(struct buffer* buffer, size_t size)
 {
-    if (buffer->msize <= (buffer->len+size))
+    // One extra byte for the NULL terminator
+    size_t needed = buffer->len + size + 1;
+    // msize is always between BUFFER_INLINE_SIZE and INT_MAX, see buffer_resize
+    if (needed <= (size_t)buffer->msize)
+    {
+        return;
+    }
+
+    size_t msize = buffer->msize * 2;
+    if (msize < BUFFER_REALLOC_AMOUNT)
+    {
+        msize = BUFFER_REALLOC_AMOUNT;
+    }
+    if (msize < needed)
     {
-        size += BUFFER_REALLOC_AMOUNT;
-        buffer_extend(buffer, size);
+        msize = needed;
     }
+    buffer_resize(buffer, msize);
 }
 
+void buffer_vprintf(struct buffer* buffer, const char* fmt, va_list args)
+{
+    va_list args_copy;
+    va_copy(args_copy, args);
+    // Format straight into the free space, this also tells us the real length
+    size_t space = buffer->msize - buffer->len;
+    int len = vsnprintf(&buffer->data[buffer->len], space, fmt, args);
+    assert(len >= 0);
+    if ((size_t)len >= space)
+    {
+        // It did not fit, now we know exactly how much room it needs
+        buffer_need(buffer, len);
+        vsnprintf(&buffer->data[buffer->len], len + 1, fmt, args_copy);
+    }
+    va_end(args_copy);
+    buffer->len += len;
+}
 
 void buffer_printf(struct buffer* buffer, const char* fmt, ...)
 {
     va_list args;
     va_start(args, fmt);
-    int index = buffer->len;
-    // Temporary, this is a limitation we are guessing the size is no more than 2048
-    int len = 2048;
-    buffer_extend(buffer, len);
-    int actual_len = vsnprintf(&buffer->data[index], len, fmt, args);
-    buffer->len += actual_len;
+    buffer_vprintf(buffer, fmt, args);
     va_end(args);
 }
 
 void buffer_printf_no_terminator(struct buffer* buffer, const char* fmt, ...)
 {
+    // The terminator is never part of len, this only exists for older callers
     va_list args;
     va_start(args, fmt);
-    int index = buffer->len;
-    // Temporary, this is a limitation we are guessing the size is no more than 2048
-    int len = 2048;
-    buffer_extend(buffer, len);
-    int actual_len = vsnprintf(&buffer->data[index], len, fmt, args);
-    buffer->len += actual_len-1;
+    buffer_vprintf(buffer, fmt, args);
     va_end(args);
 }
 
@@ -60,6 +101,35 @@ void buffer_write(struct buffer* buffer, char c)
 
     buffer->data[buffer->len] = c;
     buffer->len++;
+    buffer->data[buffer->len] = 0x00;
+}
+
+void buffer_write_n(struct buffer* buffer, const char* data, size_t len)
+{
+    buffer_need(buffer, len);
+
+    memcpy(&buffer->data[buffer->len], data, len);
+    buffer->len += len;
+    buffer->data[buffer->len] = 0x00;
+}
+
+void buffer_splice(struct buffer* buffer, size_t index, size_t remove_len, const char* data, size_t len)
+{
+    if (len > remove_len)
+    {
+        buffer_need(buffer, len - remove_len);
+    }
+
+    // Moves the NULL terminator along with the tail
+    size_t tail = buffer->len - index - remove_len + 1;
+    memmove(&buffer->data[index + len], &buffer->data[index + remove_len], tail);
+    memcpy(&buffer->data[index], data, len);
+    buffer->len += len - remove_len;
+}
+
+void buffer_append(struct buffer* buffer, struct buffer* src)
+{
+    buffer_write_n(buffer, src->data, src->len);
 }
 
 void* buffer_ptr(struct buffer* buffer)
@@ -90,7 +160,9 @@ char buffer_peek(struct buffer* buffer)
 
 void buffer_free(struct buffer* buffer)
 {
-    free(buffer->data);
+    if (buffer->data != buffer->inline_data)
+    {
+        free(buffer->data);
+    }
     free(buffer);
 }
-
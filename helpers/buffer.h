@@ -3,15 +3,23 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdarg.h>
 
+// Short contents live inside the buffer itself, bigger ones move to the heap
+#define BUFFER_INLINE_SIZE 32
+// First heap allocation once a buffer outgrows its inline storage, the capacity doubles after that
 #define BUFFER_REALLOC_AMOUNT 2000
 struct buffer
 {
+    // Points at inline_data until the buffer grows past BUFFER_INLINE_SIZE,
+    // so a buffer must never be copied by value.
+    // The data is always NULL terminated, the terminator is not counted in len
     char* data;
     // Read index
     int rindex;
     int len;
     int msize;
+    char inline_data[BUFFER_INLINE_SIZE];
 };
 
 struct buffer* buffer_create();
@@ -20,11 +28,28 @@ char buffer_read(struct buffer* buffer);
 char buffer_peek(struct buffer* buffer);
 
 void buffer_extend(struct buffer* buffer, size_t size);
+/**
+ * Makes sure size more bytes can be written without reallocating
+ */
+void buffer_need(struct buffer* buffer, size_t size);
 void buffer_printf(struct buffer* buffer, const char* fmt, ...);
+void buffer_vprintf(struct buffer* buffer, const char* fmt, va_list args);
 void buffer_printf_no_terminator(struct buffer* buffer, const char* fmt, ...);
 void buffer_write(struct buffer* buffer, char c);
+/**
+ * Writes len bytes of data at once
+ */
+void buffer_write_n(struct buffer* buffer, const char* data, size_t len);
+/**
+ * Replaces remove_len bytes at index with len bytes of data
+ */
+void buffer_splice(struct buffer* buffer, size_t index, size_t remove_len, const char* data, size_t len);
+/**
+ * Appends everything written to src to the end of buffer
+ */
+void buffer_append(struct buffer* buffer, struct buffer* src);
 void* buffer_ptr(struct buffer* buffer);
 void buffer_free(struct buffer* buffer);
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,151 @@
+#include "intern.h"
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static struct intern_entry* intern_entry(const char* interned)
+{
+    return (struct intern_entry*)(interned - offsetof(struct intern_entry, str));
+}
+
+uint32_t intern_hash(const char* str, size_t len)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+struct intern_table* intern_table_create()
+{
+    struct intern_table* table = calloc(sizeof(struct intern_table), 1);
+    table->arena = arena_create();
+    table->slots = calloc(INTERN_TABLE_INITIAL_SLOTS, sizeof(struct intern_entry*));
+    table->mask = INTERN_TABLE_INITIAL_SLOTS - 1;
+    table->entries_size = INTERN_TABLE_INITIAL_SLOTS;
+    table->entries = calloc(table->entries_size, sizeof(struct intern_entry*));
+    table->allocated = (INTERN_TABLE_INITIAL_SLOTS + table->entries_size) * sizeof(struct intern_entry*);
+    return table;
+}
+
+void intern_table_free(struct intern_table* table)
+{
+    arena_free(table->arena);
+    free(table->slots);
+    free(table->entries);
+    free(table);
+}
+
+static struct intern_entry** intern_find_slot(struct intern_table* table, const char* str, size_t len, uint32_t hash)
+{
+    uint32_t index = hash & table->mask;
+    while (1)
+    {
+        struct intern_entry** slot = &table->slots[index];
+        struct intern_entry* entry = *slot;
+        if (!entry || (entry->hash == hash && entry->len == len && memcmp(entry->str, str, len) == 0))
+        {
+            return slot;
+        }
+        index = (index + 1) & table->mask;
+    }
+}
+
+static void intern_grow(struct intern_table* table)
+{
+    uint32_t old_size = table->mask + 1;
+    struct intern_entry** old_slots = table->slots;
+    table->slots = calloc(old_size * 2, sizeof(struct intern_entry*));
+    table->mask = old_size * 2 - 1;
+    table->allocated += old_size * 2 * sizeof(struct intern_entry*);
+    for (uint32_t i = 0; i < old_size; i++)
+    {
+        struct intern_entry* entry = old_slots[i];
+        if (!entry)
+            continue;
+
+        uint32_t index = entry->hash & table->mask;
+        while (table->slots[index])
+        {
+            index = (index + 1) & table->mask;
+        }
+        table->slots[index] = entry;
+    }
+    free(old_slots);
+}
+
+const char* intern_lookup(struct intern_table* table, const char* str, size_t len)
+{
+    struct intern_entry* entry = *intern_find_slot(table, str, len, intern_hash(str, len));
+    return entry ? entry->str : NULL;
+}
+
+const char* intern(struct intern_table* table, const char* str, size_t len)
+{
+    uint32_t hash = intern_hash(str, len);
+    struct intern_entry** slot = intern_find_slot(table, str, len, hash);
+    if (*slot)
+    {
+        return (*slot)->str;
+    }
+
+    struct intern_entry* entry = arena_alloc_aligned(table->arena, sizeof(struct intern_entry) + len + 1, sizeof(uint32_t));
+    entry->hash = hash;
+    entry->len = len;
+    memcpy(entry->str, str, len);
+    entry->str[len] = 0x00;
+    *slot = entry;
+
+    table->count++;
+    entry->id = table->count;
+    if (entry->id >= table->entries_size)
+    {
+        table->entries_size *= 2;
+        table->entries = realloc(table->entries, table->entries_size * sizeof(struct intern_entry*));
+        table->allocated += table->entries_size * sizeof(struct intern_entry*);
+    }
+    table->entries[entry->id] = entry;
+
+    // Keep the load factor under 1/2
+    if (table->count * 2 > table->mask)
+    {
+        intern_grow(table);
+    }
+    return entry->str;
+}
+
+const char* intern_str(struct intern_table* table, const char* str)
+{
+    return intern(table, str, strlen(str));
+}
+
+uint32_t intern_id(const char* interned)
+{
+    return intern_entry(interned)->id;
+}
+
+size_t intern_len(const char* interned)
+{
+    return intern_entry(interned)->len;
+}
+
+const char* intern_at(struct intern_table* table, uint32_t id)
+{
+    assert(id > 0 && id <= table->count);
+    return table->entries[id]->str;
+}
+
+uint32_t intern_count(struct intern_table* table)
+{
+    return table->count;
+}
+
+size_t intern_bytes(struct intern_table* table)
+{
+    return table->allocated + table->arena->allocated;
+}
@@ -0,0 +1,71 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Initial amount of slots, always a power of two
+#define INTERN_TABLE_INITIAL_SLOTS 1024
+
+struct arena;
+
+/**
+ * Every interned string is stored once behind this header, the pointer handed
+ * out by intern() points at str so it can be used as a normal C string.
+ */
+struct intern_entry
+{
+    uint32_t hash;
+    // Atom id, starts at 1 so 0 can be used as "no string"
+    uint32_t id;
+    uint32_t len;
+    char str[];
+};
+
+struct intern_table
+{
+    // Strings live here and never move, they are released with the table
+    struct arena* arena;
+    // Open addressing hash table of entries
+    struct intern_entry** slots;
+    uint32_t mask;
+    uint32_t count;
+    // id -> entry, entries[0] is unused
+    struct intern_entry** entries;
+    uint32_t entries_size;
+    // Bytes allocated for slots and entries so far, never goes down
+    size_t allocated;
+};
+
+struct intern_table* intern_table_create();
+void intern_table_free(struct intern_table* table);
+
+/**
+ * Returns the single stored copy of the len bytes at str, str does not have to be
+ * NULL terminated. Equal spellings always return the same pointer.
+ */
+const char* intern(struct intern_table* table, const char* str, size_t len);
+const char* intern_str(struct intern_table* table, const char* str);
+
+/**
+ * Returns the interned string if it exists without adding it, NULL otherwise
+ */
+const char* intern_lookup(struct intern_table* table, const char* str, size_t len);
+
+/**
+ * Returns the 32 bit atom id of a string returned by intern()
+ */
+uint32_t intern_id(const char* interned);
+size_t intern_len(const char* interned);
+const char* intern_at(struct intern_table* table, uint32_t id);
+uint32_t intern_count(struct intern_table* table);
+
+/**
+ * Returns the bytes allocated since the table was created, strings included
+ */
+size_t intern_bytes(struct intern_table* table);
+
+uint32_t intern_hash(const char* str, size_t len);
+
+#endif
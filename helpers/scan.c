@@ -0,0 +1,258 @@
+#include "scan.h"
+#include <stdbool.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_HAVE_X86
+#include <immintrin.h>
+#endif
+
+static const bool scan_identifier_table[256] = {
+    ['0'] = 1, ['1'] = 1, ['2'] = 1, ['3'] = 1, ['4'] = 1, ['5'] = 1, ['6'] = 1, ['7'] = 1, ['8'] = 1, ['9'] = 1,
+    ['A'] = 1, ['B'] = 1, ['C'] = 1, ['D'] = 1, ['E'] = 1, ['F'] = 1, ['G'] = 1, ['H'] = 1, ['I'] = 1, ['J'] = 1,
+    ['K'] = 1, ['L'] = 1, ['M'] = 1, ['N'] = 1, ['O'] = 1, ['P'] = 1, ['Q'] = 1, ['R'] = 1, ['S'] = 1, ['T'] = 1,
+    ['U'] = 1, ['V'] = 1, ['W'] = 1, ['X'] = 1, ['Y'] = 1, ['Z'] = 1, ['_'] = 1,
+    ['a'] = 1, ['b'] = 1, ['c'] = 1, ['d'] = 1, ['e'] = 1, ['f'] = 1, ['g'] = 1, ['h'] = 1, ['i'] = 1, ['j'] = 1,
+    ['k'] = 1, ['l'] = 1, ['m'] = 1, ['n'] = 1, ['o'] = 1, ['p'] = 1, ['q'] = 1, ['r'] = 1, ['s'] = 1, ['t'] = 1,
+    ['u'] = 1, ['v'] = 1, ['w'] = 1, ['x'] = 1, ['y'] = 1, ['z'] = 1};
+
+static const char* scan_byte2_scalar(const char* p, const char* end, char a, char b)
+{
+    while (p < end && *p != a && *p != b)
+    {
+        p++;
+    }
+    return p;
+}
+
+static const char* scan_identifier_scalar(const char* p, const char* end)
+{
+    while (p < end && scan_identifier_table[(unsigned char)*p])
+    {
+        p++;
+    }
+    return p;
+}
+
+static const char* scan_blank_scalar(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+    {
+        p++;
+    }
+    return p;
+}
+
+static size_t scan_lines_scalar(const char* p, const char* end, const char* base, uint32_t* out)
+{
+    size_t count = 0;
+    for (; p < end; p++)
+    {
+        if (*p != '\n')
+            continue;
+        if (out)
+            out[count] = p - base + 1;
+        count++;
+    }
+    return count;
+}
+
+static const struct scan_kernels scan_kernels_scalar = {
+    .name = "scalar",
+    .byte2 = scan_byte2_scalar,
+    .identifier = scan_identifier_scalar,
+    .blank = scan_blank_scalar,
+    .lines = scan_lines_scalar};
+
+#ifdef SCAN_HAVE_X86
+
+// The vector loops stop once less than a full vector is left and let the scalar
+// version finish, so nothing past end is ever loaded
+
+__attribute__((target("sse2"))) static const char* scan_byte2_sse2(const char* p, const char* end, char a, char b)
+{
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+    return scan_byte2_scalar(p, end, a, b);
+}
+
+// Bytes above 0x7f compare as negative and so never fall into one of the ranges
+__attribute__((target("sse2"))) static const char* scan_identifier_sse2(const char* p, const char* end)
+{
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i before_a = _mm_set1_epi8('a' - 1);
+    const __m128i after_z = _mm_set1_epi8('z' + 1);
+    const __m128i before_0 = _mm_set1_epi8('0' - 1);
+    const __m128i after_9 = _mm_set1_epi8('9' + 1);
+    const __m128i underscore = _mm_set1_epi8('_');
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i lower = _mm_or_si128(v, case_bit);
+        __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, before_a), _mm_cmplt_epi8(lower, after_z));
+        __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, before_0), _mm_cmplt_epi8(v, after_9));
+        __m128i ok = _mm_or_si128(_mm_or_si128(alpha, digit), _mm_cmpeq_epi8(v, underscore));
+        unsigned mask = ~_mm_movemask_epi8(ok) & 0xffff;
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+    return scan_identifier_scalar(p, end);
+}
+
+__attribute__((target("sse2"))) static const char* scan_blank_sse2(const char* p, const char* end)
+{
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i ok = _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab));
+        unsigned mask = ~_mm_movemask_epi8(ok) & 0xffff;
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+    return scan_blank_scalar(p, end);
+}
+
+// Writes the offsets for the set bits of mask, lowest first
+static inline size_t scan_lines_mask(unsigned mask, const char* p, const char* base, uint32_t* out)
+{
+    size_t count = 0;
+    for (; mask; mask &= mask - 1)
+    {
+        out[count++] = p - base + __builtin_ctz(mask) + 1;
+    }
+    return count;
+}
+
+__attribute__((target("sse2"))) static size_t scan_lines_sse2(const char* p, const char* end, const char* base, uint32_t* out)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t count = 0;
+    for (; end - p >= 16; p += 16)
+    {
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), newline));
+        if (out)
+            count += scan_lines_mask(mask, p, base, out + count);
+        else
+            count += __builtin_popcount(mask);
+    }
+    return count + scan_lines_scalar(p, end, base, out ? out + count : NULL);
+}
+
+__attribute__((target("avx2"))) static const char* scan_byte2_avx2(const char* p, const char* end, char a, char b)
+{
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)));
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+    return scan_byte2_sse2(p, end, a, b);
+}
+
+__attribute__((target("avx2"))) static const char* scan_identifier_avx2(const char* p, const char* end)
+{
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    const __m256i before_a = _mm256_set1_epi8('a' - 1);
+    const __m256i after_z = _mm256_set1_epi8('z' + 1);
+    const __m256i before_0 = _mm256_set1_epi8('0' - 1);
+    const __m256i after_9 = _mm256_set1_epi8('9' + 1);
+    const __m256i underscore = _mm256_set1_epi8('_');
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i lower = _mm256_or_si256(v, case_bit);
+        __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, before_a), _mm256_cmpgt_epi8(after_z, lower));
+        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, before_0), _mm256_cmpgt_epi8(after_9, v));
+        __m256i ok = _mm256_or_si256(_mm256_or_si256(alpha, digit), _mm256_cmpeq_epi8(v, underscore));
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(ok);
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+    return scan_identifier_sse2(p, end);
+}
+
+__attribute__((target("avx2"))) static const char* scan_blank_avx2(const char* p, const char* end)
+{
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i ok = _mm256_or_si256(_mm256_cmpeq_epi8(v, space), _mm256_cmpeq_epi8(v, tab));
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(ok);
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+    return scan_blank_sse2(p, end);
+}
+
+__attribute__((target("avx2"))) static size_t scan_lines_avx2(const char* p, const char* end, const char* base, uint32_t* out)
+{
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t count = 0;
+    for (; end - p >= 32; p += 32)
+    {
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)p), newline));
+        if (out)
+            count += scan_lines_mask(mask, p, base, out + count);
+        else
+            count += __builtin_popcount(mask);
+    }
+    return count + scan_lines_sse2(p, end, base, out ? out + count : NULL);
+}
+
+static const struct scan_kernels scan_kernels_sse2 = {
+    .name = "sse2",
+    .byte2 = scan_byte2_sse2,
+    .identifier = scan_identifier_sse2,
+    .blank = scan_blank_sse2,
+    .lines = scan_lines_sse2};
+
+static const struct scan_kernels scan_kernels_avx2 = {
+    .name = "avx2",
+    .byte2 = scan_byte2_avx2,
+    .identifier = scan_identifier_avx2,
+    .blank = scan_blank_avx2,
+    .lines = scan_lines_avx2};
+
+#endif
+
+const struct scan_kernels* scan_active = &scan_kernels_scalar;
+
+int scan_select(int impl)
+{
+#ifdef SCAN_HAVE_X86
+    __builtin_cpu_init();
+    if (impl >= SCAN_IMPL_AVX2 && __builtin_cpu_supports("avx2"))
+    {
+        scan_active = &scan_kernels_avx2;
+        return SCAN_IMPL_AVX2;
+    }
+    if (impl >= SCAN_IMPL_SSE2 && __builtin_cpu_supports("sse2"))
+    {
+        scan_active = &scan_kernels_sse2;
+        return SCAN_IMPL_SSE2;
+    }
+#endif
+    scan_active = &scan_kernels_scalar;
+    return SCAN_IMPL_SCALAR;
+}
+
+#ifdef __GNUC__
+// Runs before main, so the lexer never sees the kernels change under it
+__attribute__((constructor)) static void scan_init()
+{
+    scan_select(SCAN_IMPL_AVX2);
+}
+#endif
@@ -0,0 +1,62 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum
+{
+    SCAN_IMPL_SCALAR,
+    SCAN_IMPL_SSE2,
+    SCAN_IMPL_AVX2
+};
+
+/**
+ * Kernels that find the end of a run of bytes, 16 or 32 bytes at a time when
+ * the CPU allows it. They only read inside [p, end) and return end when the run
+ * does not stop before it.
+ */
+struct scan_kernels
+{
+    const char* name;
+    // First byte equal to a or b
+    const char* (*byte2)(const char* p, const char* end, char a, char b);
+    // First byte that is not [A-Za-z0-9_]
+    const char* (*identifier)(const char* p, const char* end);
+    // First byte that is not a space or a tab
+    const char* (*blank)(const char* p, const char* end);
+    // Number of '\n' in [p, end), when out is not NULL the offset from base of the
+    // byte after each one is written to it
+    size_t (*lines)(const char* p, const char* end, const char* base, uint32_t* out);
+};
+
+// The kernels in use, the best ones the CPU supports are picked at startup
+extern const struct scan_kernels* scan_active;
+
+static inline const char* scan_byte2(const char* p, const char* end, char a, char b)
+{
+    return scan_active->byte2(p, end, a, b);
+}
+
+static inline const char* scan_identifier(const char* p, const char* end)
+{
+    return scan_active->identifier(p, end);
+}
+
+static inline const char* scan_blank(const char* p, const char* end)
+{
+    return scan_active->blank(p, end);
+}
+
+static inline size_t scan_lines(const char* p, const char* end, const char* base, uint32_t* out)
+{
+    return scan_active->lines(p, end, base, out);
+}
+
+/**
+ * Switches to the given SCAN_IMPL_xxx, or the best one below it the CPU supports.
+ * Returns the implementation now in use
+ */
+int scan_select(int impl);
+
+#endif
@@ -0,0 +1,126 @@
+#include "threadpool.h"
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+struct threadpool_worker
+{
+    struct threadpool* pool;
+    int index;
+};
+
+struct threadpool* threadpool_create(int total_threads)
+{
+    assert(total_threads > 0);
+    struct threadpool* pool = calloc(sizeof(struct threadpool), 1);
+    pool->total_threads = total_threads;
+    pool->queues = calloc(sizeof(struct threadpool_queue), total_threads);
+    for (int i = 0; i < total_threads; i++)
+    {
+        pthread_mutex_init(&pool->queues[i].lock, NULL);
+    }
+    return pool;
+}
+
+void threadpool_submit(struct threadpool* pool, THREADPOOL_JOB_FUNCTION function, void* arg)
+{
+    struct threadpool_queue* queue = &pool->queues[pool->next_queue];
+    pool->next_queue = (pool->next_queue + 1) % pool->total_threads;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail >= queue->msize)
+    {
+        queue->msize = queue->msize ? queue->msize * 2 : 16;
+        queue->jobs = realloc(queue->jobs, queue->msize * sizeof(struct threadpool_job));
+    }
+    queue->jobs[queue->tail++] = (struct threadpool_job){.function = function, .arg = arg};
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static bool threadpool_queue_take(struct threadpool_queue* queue, struct threadpool_job* job, bool steal)
+{
+    bool res = false;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail)
+    {
+        // The owner works front to back, thieves take from the back
+        *job = steal ? queue->jobs[--queue->tail] : queue->jobs[queue->head++];
+        res = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return res;
+}
+
+static bool threadpool_next_job(struct threadpool* pool, int index, struct threadpool_job* job)
+{
+    if (threadpool_queue_take(&pool->queues[index], job, false))
+    {
+        return true;
+    }
+
+    for (int i = 1; i < pool->total_threads; i++)
+    {
+        int victim = (index + i) % pool->total_threads;
+        if (threadpool_queue_take(&pool->queues[victim], job, true))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void* threadpool_worker_main(void* arg)
+{
+    struct threadpool_worker* worker = arg;
+    struct threadpool_job job;
+    // Jobs never submit new jobs, so once every queue is empty we are done
+    while (threadpool_next_job(worker->pool, worker->index, &job))
+    {
+        job.function(job.arg);
+    }
+    return NULL;
+}
+
+void threadpool_run(struct threadpool* pool)
+{
+    struct threadpool_worker* workers = calloc(sizeof(struct threadpool_worker), pool->total_threads);
+    pthread_t* threads = calloc(sizeof(pthread_t), pool->total_threads);
+    bool* started = calloc(sizeof(bool), pool->total_threads);
+    for (int i = 1; i < pool->total_threads; i++)
+    {
+        workers[i] = (struct threadpool_worker){.pool = pool, .index = i};
+        started[i] = pthread_create(&threads[i], NULL, threadpool_worker_main, &workers[i]) == 0;
+    }
+
+    // The calling thread is worker 0. It only stops once every queue is empty,
+    // so it also steals the jobs of any worker whose thread could not be created
+    workers[0] = (struct threadpool_worker){.pool = pool, .index = 0};
+    threadpool_worker_main(&workers[0]);
+
+    for (int i = 1; i < pool->total_threads; i++)
+    {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+    }
+    free(started);
+    free(threads);
+    free(workers);
+
+    for (int i = 0; i < pool->total_threads; i++)
+    {
+        pool->queues[i].head = 0;
+        pool->queues[i].tail = 0;
+    }
+    pool->next_queue = 0;
+}
+
+void threadpool_free(struct threadpool* pool)
+{
+    for (int i = 0; i < pool->total_threads; i++)
+    {
+        pthread_mutex_destroy(&pool->queues[i].lock);
+        free(pool->queues[i].jobs);
+    }
+    free(pool->queues);
+    free(pool);
+}
@@ -0,0 +1,50 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+typedef void (*THREADPOOL_JOB_FUNCTION)(void* arg);
+
+struct threadpool_job
+{
+    THREADPOOL_JOB_FUNCTION function;
+    void* arg;
+};
+
+/**
+ * Each worker owns one of these, it takes jobs from the front of its own queue
+ * and steals from the back of the other queues once its own is empty
+ */
+struct threadpool_queue
+{
+    pthread_mutex_t lock;
+    struct threadpool_job* jobs;
+    int head;
+    int tail;
+    int msize;
+};
+
+struct threadpool
+{
+    int total_threads;
+    struct threadpool_queue* queues;
+    // Queue the next submitted job goes to
+    int next_queue;
+};
+
+struct threadpool* threadpool_create(int total_threads);
+
+/**
+ * Queues a job, jobs are handed out round robin so submitting the most
+ * expensive jobs first makes every worker start on a big one
+ */
+void threadpool_submit(struct threadpool* pool, THREADPOOL_JOB_FUNCTION function, void* arg);
+
+/**
+ * Runs every submitted job and returns once all of them finished
+ */
+void threadpool_run(struct threadpool* pool);
+void threadpool_free(struct threadpool* pool);
+
+#endif
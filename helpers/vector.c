@@ -50,21 +50,25 @@ struct vector *vector_clone(struct vector *vector)
     struct vector *new_vec = calloc(sizeof(struct vector), 1);
     memcpy(new_vec, vector, sizeof(struct vector));
     new_vec->data = new_data_address;
+    new_vec->mindex = vector->count + VECTOR_ELEMENT_INCREMENT;
 
-    // Saves are not cloned with vector_clone yet.
-    // assert(vector->saves == NULL);
+    // Saves are not cloned with vector_clone
+    new_vec->saves = NULL;
     return new_vec;
 }
 
 struct vector *vector_create(size_t esize)
 {
-    struct vector *vec = vector_create_no_saves(esize);
-    vec->saves = vector_create_no_saves(sizeof(struct vector));
-    return vec;
+    // The save stack is created by the first vector_save, most vectors never need one
+    return vector_create_no_saves(esize);
 }
 
 void vector_free(struct vector *vector)
 {
+    if (vector->saves)
+    {
+        vector_free(vector->saves);
+    }
     free(vector->data);
     free(vector);
 }
@@ -74,17 +78,47 @@ int vector_current_index(struct vector *vector)
     return vector->rindex;
 }
 
-void vector_resize_for_index(struct vector *vector, int start_index, int total_elements)
+void vector_reserve(struct vector *vector, int total_elements)
 {
-    if (start_index + total_elements < vector->mindex)
+    if (total_elements <= vector->mindex)
     {
         // Nothing to resize
         return;
     }
 
-    vector->data = realloc(vector->data, ((start_index + total_elements + VECTOR_ELEMENT_INCREMENT) * vector->esize));
+    // Grow geometrically so pushing N elements only copies O(N) bytes in total
+    int new_mindex = vector->mindex * 2;
+    if (new_mindex < total_elements)
+    {
+        new_mindex = total_elements;
+    }
+    if (new_mindex < VECTOR_ELEMENT_INCREMENT)
+    {
+        new_mindex = VECTOR_ELEMENT_INCREMENT;
+    }
+
+    vector->data = realloc(vector->data, new_mindex * vector->esize);
+    assert(vector->data);
+    vector->mindex = new_mindex;
+}
+
+void vector_shrink_to_fit(struct vector *vector)
+{
+    int new_mindex = vector->count > 0 ? vector->count : 1;
+    if (new_mindex == vector->mindex)
+    {
+        return;
+    }
+
+    vector->data = realloc(vector->data, new_mindex * vector->esize);
     assert(vector->data);
-    vector->mindex = start_index + total_elements;
+    vector->mindex = new_mindex;
+}
+
+void vector_resize_for_index(struct vector *vector, int start_index, int total_elements)
+{
+    // Always keep room for one more element past the range
+    vector_reserve(vector, start_index + total_elements + 1);
 }
 
 void vector_resize_for(struct vector *vector, int total_elements)
@@ -206,6 +240,11 @@ void *vector_back_ptr(struct vector *vector)
 
 void vector_save(struct vector *vector)
 {
+    if (!vector->saves)
+    {
+        vector->saves = vector_create_no_saves(sizeof(struct vector));
+    }
+
     // Let's save the state of this vector to its self
     struct vector tmp_vec = *vector;
     // We not allowed to modify the saves so set it to NULL
@@ -216,6 +255,7 @@ void vector_save(struct vector *vector)
 
 void vector_restore(struct vector *vector)
 {
+    assert(vector->saves);
     struct vector save_vec = *((struct vector *)(vector_back(vector->saves)));
     save_vec.saves = vector->saves;
     *vector = save_vec;
@@ -224,6 +264,7 @@ void vector_restore(struct vector *vector)
 
 void vector_save_purge(struct vector *vector)
 {
+    assert(vector->saves);
     vector_pop(vector->saves);
 }
 
@@ -235,16 +276,16 @@ void vector_pop_last_peek(struct vector* vector)
 
 void vector_push(struct vector *vector, void *elem)
 {
+    if (vector->rindex >= vector->mindex)
+    {
+        vector_reserve(vector, vector->rindex + 1);
+    }
+
     void *ptr = vector_at(vector, vector->rindex);
     memcpy(ptr, elem, vector->esize);
 
     vector->rindex++;
     vector->count++;
-
-    if (vector->rindex >= vector->mindex)
-    {
-        vector_resize(vector);
-    }
 }
 
 int vector_fread(struct vector *vector, int amount, FILE *fp)
@@ -281,10 +322,11 @@ int vector_elements_until_end(struct vector *vector, int index)
 
 void vector_shift_right_in_bounds_no_increment(struct vector *vector, int index, int amount)
 {
-    vector_resize_for_index(vector, index, amount);
+    int total = index > vector->count ? index : vector->count;
+    vector_resize_for_index(vector, total, amount);
     int eindex = (index + amount);
     size_t bytes_to_move = vector_elements_until_end(vector, index) * vector->esize;
-    memcpy(vector_at(vector, eindex), vector_at(vector, index), bytes_to_move);
+    memmove(vector_at(vector, eindex), vector_at(vector, index), bytes_to_move);
     memset(vector_at(vector, index), 0x00, amount * vector->esize);
 }
 
@@ -352,11 +394,30 @@ void vector_pop_at(struct vector *vector, int index)
     void *next_element_pos = dst_pos + vector->esize;
     void *end_pos = vector_data_end(vector);
     size_t total = (size_t)end_pos - (size_t)next_element_pos;
-    memcpy(dst_pos, next_element_pos, total);
+    memmove(dst_pos, next_element_pos, total);
     vector->count -= 1;
     vector->rindex -= 1;
 }
 
+void vector_splice(struct vector *vector, int index, int remove_count, const void *elems, int total)
+{
+    int new_count = vector->rindex - remove_count + total;
+    if (new_count > vector->mindex)
+    {
+        vector_reserve(vector, new_count);
+    }
+
+    char *base = vector->data;
+    size_t tail = (size_t)(vector->rindex - index - remove_count) * vector->esize;
+    memmove(base + (index + total) * vector->esize, base + (index + remove_count) * vector->esize, tail);
+    if (total)
+    {
+        memcpy(base + index * vector->esize, elems, total * vector->esize);
+    }
+    vector->count += total - remove_count;
+    vector->rindex = new_count;
+}
+
 void vector_peek_pop(struct vector *vector)
 {
     // Popping at a peek is an akward one
@@ -7,8 +7,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 
-// We want at least 20 vector element spaces in reserve before having
-// to reallocate memory again
+// Vectors start with room for 20 elements and double their capacity
+// whenever they run out
 #define VECTOR_ELEMENT_INCREMENT 20
 
 enum
@@ -23,6 +23,7 @@ struct vector
     // This index will then be incremented
     int pindex;
     int rindex;
+    // Capacity in elements
     int mindex;
     int count;
     int flags;
@@ -33,13 +34,22 @@ struct vector
     // at all times with vector_save
     // Data is not restored and is permenant, save does not respect data, only pointers
     // and variables are saved. Useful to temporarily push the vector state
-    // and restore it later.
+    // and restore it later. NULL until the first vector_save.
     struct vector* saves;
 };
 
 
 struct vector* vector_create(size_t esize);
 void vector_free(struct vector* vector);
+
+/**
+ * Makes sure the vector can hold total_elements without reallocating
+ */
+void vector_reserve(struct vector* vector, int total_elements);
+/**
+ * Releases the capacity that is not used by any element
+ */
+void vector_shrink_to_fit(struct vector* vector);
 void* vector_at(struct vector* vector, int index);
 void* vector_peek_ptr_at(struct vector* vector, int index);
 void* vector_peek_no_increment(struct vector* vector);
@@ -110,6 +120,12 @@ int vector_pop_value(struct vector* vector, void* val);
 
 void vector_pop_at(struct vector *vector, int index);
 
+/**
+ * Replaces remove_count elements starting at index with total elements from elems,
+ * moving the rest of the vector only once
+ */
+void vector_splice(struct vector *vector, int index, int remove_count, const void *elems, int total);
+
 /**
  * Decrements the peek pointer so that the next peek
  * will point at the last peeked token
@@ -148,4 +164,31 @@ size_t vector_element_size(struct vector* vector);
  */
 struct vector* vector_clone(struct vector* vector);
 
+/**
+ * Generates name_push, name_at and name_back for a vector whose elements are of the given type.
+ * They load and store the element directly instead of memcpy'ing esize bytes.
+ *
+ * VECTOR_DEFINE_TYPED(token_vec, struct token)
+ * token_vec_push(vec, token);
+ */
+#define VECTOR_DEFINE_TYPED(name, type)                                    \
+    static inline void name##_push(struct vector* vector, type value)      \
+    {                                                                      \
+        if (vector->rindex >= vector->mindex)                              \
+        {                                                                  \
+            vector_reserve(vector, vector->rindex + 1);                    \
+        }                                                                  \
+        ((type*)vector->data)[vector->rindex] = value;                     \
+        vector->rindex++;                                                  \
+        vector->count++;                                                   \
+    }                                                                      \
+    static inline type* name##_at(struct vector* vector, int index)        \
+    {                                                                      \
+        return &((type*)vector->data)[index];                              \
+    }                                                                      \
+    static inline type* name##_back(struct vector* vector)                 \
+    {                                                                      \
+        return vector->rindex > 0 ? &((type*)vector->data)[vector->rindex - 1] : NULL; \
+    }
+
 #endif
\ No newline at end of file
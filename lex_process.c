@@ -1,5 +1,5 @@
 #include"compiler.h"
-#include"helpers/vector.h"
+#include"helpers/buffer.h"
 
 struct lex_process* lex_process_create(struct compile_process* compiler, struct lex_process_functions* function, void* lex_private)
 {
@@ -7,26 +7,125 @@ struct lex_process* lex_process_create(struct compile_process* compiler, struct
     lexer->compiler = compiler;
     lexer->function = function;
     lexer->lex_private = lex_private;
-    lexer->token_vec = vector_create(sizeof(struct token));
-    lexer->pos.line = 1;
-    lexer->pos.col = 1;
+    lexer->tokens = token_store_create(compiler->strings);
     return lexer;
 }
 
 void lex_process_free(struct lex_process* lexer)
 {
-    vector_free(lexer->token_vec);
+    if (lexer->source_buffer)
+        buffer_free(lexer->source_buffer);
+    free(lexer->edit_source.data);
+    if (lexer->tokens)
+        token_store_free(lexer->tokens);
     free(lexer);
 }
 
+void lex_process_set_source(struct lex_process* lexer, const char* data, size_t size)
+{
+    lexer->source.start = data;
+    lexer->source.cur = data;
+    lexer->source.end = data + size;
+    lexer->tokens->source = data;
+}
+
+// 没有直接给出源码时, 先通过function把输入全部读进来, lexer只在内存上工作
+void lex_process_read_source(struct lex_process* lexer)
+{
+    struct buffer* buff = buffer_create();
+    for (char c = lexer->function->next_char(lexer); c != EOF; c = lexer->function->next_char(lexer))
+    {
+        buffer_write(buff, c);
+    }
+    lexer->source_buffer = buff;
+    lex_process_set_source(lexer, buffer_ptr(buff), buff->len);
+}
+
 void* lex_process_private(struct lex_process* lexer)
 {
     return lexer->lex_private;
 }
 
-struct vector* lex_process_tokens(struct lex_process* lexer)
+// 只搬动gap原来的位置和新位置之间的字节
+static void lex_process_move_gap(struct lex_edit_source* edit, size_t gap)
+{
+    if (gap < edit->gap)
+        memmove(edit->data + gap + edit->gap_len, edit->data + gap, edit->gap - gap);
+    else
+        memmove(edit->data + edit->gap, edit->data + edit->gap + edit->gap_len, gap - edit->gap);
+    edit->gap = gap;
+}
+
+// gap放不下len个字节时容量翻倍, gap之后的源码搬到最后
+static void lex_process_reserve_gap(struct lex_edit_source* edit, size_t len)
+{
+    if (edit->gap_len >= len)
+    {
+        return;
+    }
+    size_t capacity = edit->capacity * 2 + len;
+    size_t after = edit->capacity - edit->gap - edit->gap_len;
+    edit->data = realloc(edit->data, capacity + 1);
+    memmove(edit->data + capacity - after, edit->data + edit->capacity - after, after);
+    edit->gap_len += capacity - edit->capacity;
+    edit->capacity = capacity;
+    edit->data[capacity] = 0;
+}
+
+void lex_process_splice_source(struct lex_process* lexer, size_t start, size_t end, const char* text, size_t len, size_t restart)
+{
+    struct lex_edit_source* edit = &lexer->edit_source;
+    if (!edit->data)
+    {
+        // 第一次修改时复制源码, gap直接放在start
+        size_t size = lexer->source.end - lexer->source.start;
+        edit->capacity = size + size / 2 + len;
+        edit->data = malloc(edit->capacity + 1);
+        edit->data[edit->capacity] = 0;
+        edit->gap = start;
+        edit->gap_len = edit->capacity - size;
+        memcpy(edit->data, lexer->source.start, start);
+        memcpy(edit->data + start + edit->gap_len, lexer->source.start + start, size - start);
+    }
+
+    lex_process_move_gap(edit, start);
+    edit->gap_len += end - start;
+    lex_process_reserve_gap(edit, len);
+    memcpy(edit->data + edit->gap, text, len);
+    edit->gap += len;
+    edit->gap_len -= len;
+    lex_process_move_gap(edit, restart);
+
+    // gap之后的字节在base + 偏移
+    size_t size = edit->capacity - edit->gap_len;
+    const char* base = edit->data + edit->gap_len;
+    lexer->source.start = base;
+    lexer->source.cur = base + restart;
+    lexer->source.end = base + size;
+    lexer->file = source_file_update(lexer->compiler, lexer->file, edit->data, size, edit->gap, edit->gap_len);
+}
+
+struct token_store* lex_process_tokens(struct lex_process* lexer)
 {
-    return lexer->token_vec;
+    struct lex_edit_source* edit = &lexer->edit_source;
+    if (edit->data)
+    {
+        // gap移到最后, 源码又是连续的
+        size_t size = edit->capacity - edit->gap_len;
+        lex_process_move_gap(edit, size);
+        edit->data[size] = 0;
+        lexer->file = source_file_update(lexer->compiler, lexer->file, edit->data, size, size, 0);
+        lexer->source.start = edit->data;
+        lexer->source.cur = edit->data;
+        lexer->source.end = edit->data + size;
+    }
+    if (lexer->tokens)
+    {
+        token_store_move_gap(lexer->tokens, lexer->tokens->count);
+        if (edit->data)
+            lexer->tokens->source = edit->data;
+    }
+    return lexer->tokens;
 }
 
 
@@ -1,106 +1,125 @@
 #include "compiler.h"
 #include "helpers/buffer.h"
-#include "helpers/vector.h"
+#include "helpers/scan.h"
+#include <stddef.h>
 #include <string.h>
 #include <assert.h>
-#include <ctype.h>
 
-#define LEX_GETC_IF(buffer, c, exp)     \
-    for (c = peekc(); exp; c = peekc()) \
-    {                                   \
-        buffer_write(buffer, c);        \
-        nextc();                        \
+// 直接在源码上跳过, 之后用 lex_source_ptr() 取出这一段
+#define LEX_SKIP_IF(c, exp)                           \
+    for (c = peekc(lexer); exp; c = peekc(lexer))     \
+    {                                                 \
+        nextc(lexer);                                 \
     }
 
-static struct lex_process *lexer;
-static struct token tmp_token;
-struct token *read_next_token();
-bool lex_is_in_expression();
+struct token *read_next_token(struct lex_process *lexer);
+bool lex_is_in_expression(struct lex_process *lexer);
 
-static char peekc()
+static char peekc(struct lex_process *lexer)
 {
-    return lexer->function->peek_char(lexer);
+    if (lexer->source.cur >= lexer->source.end)
+    {
+        return EOF;
+    }
+    return *lexer->source.cur;
 }
 
-static char nextc()
+static char nextc(struct lex_process *lexer)
 {
-    char c = lexer->function->next_char(lexer);
-    // (30+2)
-    if (lex_is_in_expression())
+    if (lexer->source.cur >= lexer->source.end)
     {
-        buffer_write(lexer->parentheses_buffer, c);
+        return EOF;
     }
-    lexer->pos.col += 1;
-    if (c == '\n')
-    {
-        lexer->pos.col = 1;
-        lexer->pos.line += 1;
-    }
-    return c;
+    return *lexer->source.cur++;
 }
 
-static void pushc(char c)
+static const char *lex_source_ptr(struct lex_process *lexer)
 {
-    lexer->function->push_char(lexer, c);
+    return lexer->source.cur;
 }
 
-static char assert_next_char(char c)
+// 一次跳到p, 和对中间每个字符调用nextc的效果一样
+static void lex_advance_to(struct lex_process *lexer, const char *p)
 {
-    char next_c = nextc();
-    assert(next_c == c);
-    return next_c;
+    lexer->source.cur = p;
 }
 
-static struct pos lex_file_position()
+static const char *lex_intern(struct lex_process *lexer, const char *str, size_t len)
 {
-    return lexer->pos;
+    return compile_process_intern(lexer->compiler, str, len);
 }
 
-struct token *token_create(struct token *_token)
+// 源码中ptr的位置
+static srcloc lex_loc(struct lex_process *lexer, const char *ptr)
 {
-    memcpy(&tmp_token, _token, sizeof(struct token));
-    tmp_token.pos = lex_file_position();
-    if (lex_is_in_expression())
-    {
-        tmp_token.between_brackets = buffer_ptr(lexer->parentheses_buffer);
-    }
-    return &tmp_token;
+    return lexer->tokens->base + (ptr - lexer->source.start);
 }
 
-static void lex_pop_token()
+static void lex_error(struct lex_process *lexer, const char *msg)
 {
-    vector_pop(lexer->token_vec);
+    lexer->compiler->loc = lex_loc(lexer, lexer->source.cur);
+    compiler_error(lexer->compiler, "%s", msg);
 }
 
-static struct token *lex_last_token()
+static char assert_next_char(struct lex_process *lexer, char c)
 {
-    return vector_back_or_null(lexer->token_vec);
+    char next_c = nextc(lexer);
+    assert(next_c == c);
+    return next_c;
 }
 
-static struct token *handle_whitespace()
+struct token *token_create(struct lex_process *lexer, struct token *_token)
 {
-    struct token *last_token = lex_last_token();
-    if (last_token)
-        last_token->whitespace = true;
+    struct token *token = &lexer->tmp_token;
+    memcpy(token, _token, sizeof(struct token));
+    token->offset = lexer->token_start - lexer->source.start;
+    token->loc = lex_loc(lexer, lexer->token_start);
+    if (lex_is_in_expression(lexer))
+    {
+        token->between_brackets.offset = lexer->expression_start;
+    }
+    return token;
+}
 
-    nextc();
-    return read_next_token();
+static void lex_pop_token(struct lex_process *lexer)
+{
+    token_store_pop(lexer->tokens);
 }
 
-const char *read_number_str()
+// 最后一个token的下标, 还没有token时为-1
+static int lex_last_token(struct lex_process *lexer)
 {
-    struct buffer *buffer = buffer_create();
-    char c = peekc();
-    LEX_GETC_IF(buffer, c, ('0' <= c && c <= '9'));
+    return lexer->tokens->count - 1;
+}
 
-    buffer_write(buffer, 0x00);
-    return buffer_ptr(buffer);
+// 最后一个token是type类型并且值为value, 比如include keyword或者数字0
+static bool lex_last_token_is(struct lex_process *lexer, int type, uint32_t value)
+{
+    struct token_store *tokens = lexer->tokens;
+    int last = lex_last_token(lexer);
+    return last >= 0 && tokens->type[last] == type && tokens->value[last] == value;
 }
 
-unsigned long long read_number()
+// 返回源码中的数字串, 长度写入len
+const char *read_number_str(struct lex_process *lexer, size_t *len)
 {
-    const char *num = read_number_str();
-    return atoll(num);
+    const char *start = lex_source_ptr(lexer);
+    char c = 0;
+    LEX_SKIP_IF(c, ('0' <= c && c <= '9'));
+    *len = lex_source_ptr(lexer) - start;
+    return start;
+}
+
+unsigned long long read_number(struct lex_process *lexer)
+{
+    size_t len = 0;
+    const char *num = read_number_str(lexer, &len);
+    unsigned long long number = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        number = number * 10 + (num[i] - '0');
+    }
+    return number;
 }
 
 int lex_number_type(char c)
@@ -117,275 +136,283 @@ int lex_number_type(char c)
     return type;
 }
 
-struct token *token_make_number_for_value(unsigned long long number)
+struct token *token_make_number_for_value(struct lex_process *lexer, unsigned long long number)
 {
-    int number_type = lex_number_type(peekc());
+    int number_type = lex_number_type(peekc(lexer));
     if (number_type != NUMBER_TYPE_NORMAL)
     {
-        nextc();
+        nextc(lexer);
     }
-    return token_create(&(struct token){.type = TOKEN_TYPE_NUMBER, .llnum = number, .num.type = number_type});
+    return token_create(lexer, &(struct token){.type = TOKEN_TYPE_NUMBER, .llnum = number, .num.type = number_type});
 }
 
 // token:: make函数 number类型
-struct token *token_make_number()
+struct token *token_make_number(struct lex_process *lexer)
 {
-    return token_make_number_for_value(read_number());
+    return token_make_number_for_value(lexer, read_number(lexer));
 }
 
-struct token *token_make_string(char start_delmt, char end_delmt)
+struct token *token_make_string(struct lex_process *lexer, char start_delmt, char end_delmt)
 {
-    struct buffer *buff = buffer_create();
-    assert(nextc() == start_delmt);
-    char c = nextc();
-    for (; c != end_delmt && c != EOF; c = nextc())
+    assert(nextc(lexer) == start_delmt);
+    const char *start = lex_source_ptr(lexer);
+    char c = 0;
+    // 反斜杠后面的字符不会结束字符串, 比如 "a\"b"
+    while (1)
     {
-        if (c == '\\')
-        {
-            // 跳过 反斜杠'\'
-            continue;
-        }
-        buffer_write(buff, c);
-    }
-    buffer_write(buff, 0x00);
-    return token_create(&(struct token){.type = TOKEN_TYPE_STRING, .sval = buffer_ptr(buff)});
-}
-
-static bool op_treated_as_one(char op)
-{
-    return op == '(' || op == '[' || op == ',' || op == '*' || op == '.' || op == '?';
-}
-
-static bool is_single_operator(char op)
-{
-    return op == '+' || op == '-' || op == '/' || op == '*' || op == '=' || op == '<' ||
-           op == '>' || op == '|' || op == '&' || op == '^' || op == '%' || op == '!' ||
-           op == '(' || op == '[' || op == ',' || op == '.' || op == '~' || op == '?';
-}
-
-static bool op_valid(const char *op)
-{
-    return S_EQ(op, "+") || S_EQ(op, "-") || S_EQ(op, "*") || S_EQ(op, "/") ||
-           S_EQ(op, "!") || S_EQ(op, "^") || S_EQ(op, "+=") || S_EQ(op, "-=") ||
-           S_EQ(op, "*=") || S_EQ(op, ">>=") || S_EQ(op, "<<=") || S_EQ(op, "/=") ||
-           S_EQ(op, ">>") || S_EQ(op, "<<") || S_EQ(op, ">=") || S_EQ(op, "<=") ||
-           S_EQ(op, "<") || S_EQ(op, "||") || S_EQ(op, "&&") || S_EQ(op, "|") ||
-           S_EQ(op, "&") || S_EQ(op, "++") || S_EQ(op, "--") || S_EQ(op, "=") ||
-           S_EQ(op, "*=") || S_EQ(op, "^=") || S_EQ(op, "==") || S_EQ(op, "!=") ||
-           S_EQ(op, "->") || S_EQ(op, "**") || S_EQ(op, "(") || S_EQ(op, "[") ||
-           S_EQ(op, ",") || S_EQ(op, ".") || S_EQ(op, "...") || S_EQ(op, "~") ||
-           S_EQ(op, "?") || S_EQ(op, "%") || S_EQ(op, ">");
-}
-
-// 当遇到+*这种操作符合法但连在一起不合法时，需要只留下+，将后面的flush回去留给下一次token
-void read_op_flush_back_keep_first(struct buffer *buff)
-{
-    const char *data = buffer_ptr(buff);
-    int len = buff->len;
-    for (int i = len - 1; i >= 1; i--)
+        lex_advance_to(lexer, scan_byte2(lexer->source.cur, lexer->source.end, end_delmt, '\\'));
+        c = nextc(lexer);
+        if (c != '\\')
+            break;
+        nextc(lexer);
+    }
+    size_t len = lex_source_ptr(lexer) - start - (c == end_delmt ? 1 : 0);
+    if (!memchr(start, '\\', len))
     {
-        if (data[i] == 0x00)
-            continue;
-        pushc(data[i]);
+        const char *str = lex_intern(lexer, start, len);
+        return token_create(lexer, &(struct token){.type = TOKEN_TYPE_STRING, .sval = str, .slen = len});
     }
-}
-
-const char *read_op()
-{
-    bool single_oprator = true;
-    struct buffer *buff = buffer_create();
-    char op = nextc();
-    buffer_write(buff, op);
 
-    if (!op_treated_as_one(op))
+    char *tmp = malloc(len);
+    size_t slen = 0;
+    for (size_t i = 0; i < len; i++)
     {
-        op = peekc();
-        if (is_single_operator(op))
+        if (start[i] == '\\' && i + 1 < len)
         {
-            buffer_write(buff, op);
-            nextc();
-            single_oprator = false;
+            // 跳过 反斜杠'\', 保留后面的字符
+            i++;
         }
-    }
-    buffer_write(buff, 0x00);
-    char *ptr = buffer_ptr(buff);
-
-    if (!single_oprator)
+        tmp[slen++] = start[i];
+    }
+    const char *str = lex_intern(lexer, tmp, slen);
+    free(tmp);
+    return token_create(lexer, &(struct token){.type = TOKEN_TYPE_STRING, .sval = str, .slen = slen});
+}
+
+// ".." 是 "..." 的前缀但本身不是操作符
+#define OPERATOR_STATE_DOT_DOT OPERATOR_COUNT
+
+// 操作符的DFA, 每个状态就是目前读到的操作符, 0表示没有转移
+static const unsigned char operator_transitions[OPERATOR_COUNT + 1][256] = {
+    [OPERATOR_NONE] = {
+        ['+'] = OPERATOR_PLUS,
+        ['-'] = OPERATOR_MINUS,
+        ['*'] = OPERATOR_STAR,
+        ['/'] = OPERATOR_SLASH,
+        ['%'] = OPERATOR_PERCENT,
+        ['='] = OPERATOR_ASSIGN,
+        ['<'] = OPERATOR_LT,
+        ['>'] = OPERATOR_GT,
+        ['!'] = OPERATOR_LOGICAL_NOT,
+        ['&'] = OPERATOR_BITWISE_AND,
+        ['|'] = OPERATOR_BITWISE_OR,
+        ['^'] = OPERATOR_BITWISE_XOR,
+        ['~'] = OPERATOR_BITWISE_NOT,
+        ['.'] = OPERATOR_DOT,
+        ['?'] = OPERATOR_QUESTION,
+        [','] = OPERATOR_COMMA,
+        ['('] = OPERATOR_LEFT_PAREN,
+        ['['] = OPERATOR_LEFT_BRACKET},
+    [OPERATOR_PLUS] = {['+'] = OPERATOR_INCREMENT, ['='] = OPERATOR_ADD_ASSIGN},
+    [OPERATOR_MINUS] = {['-'] = OPERATOR_DECREMENT, ['='] = OPERATOR_SUB_ASSIGN, ['>'] = OPERATOR_ARROW},
+    [OPERATOR_STAR] = {['='] = OPERATOR_MUL_ASSIGN},
+    [OPERATOR_SLASH] = {['='] = OPERATOR_DIV_ASSIGN},
+    [OPERATOR_PERCENT] = {['='] = OPERATOR_MOD_ASSIGN},
+    [OPERATOR_ASSIGN] = {['='] = OPERATOR_EQ},
+    [OPERATOR_LOGICAL_NOT] = {['='] = OPERATOR_NE},
+    [OPERATOR_LT] = {['='] = OPERATOR_LE, ['<'] = OPERATOR_SHL},
+    [OPERATOR_GT] = {['='] = OPERATOR_GE, ['>'] = OPERATOR_SHR},
+    [OPERATOR_SHL] = {['='] = OPERATOR_SHL_ASSIGN},
+    [OPERATOR_SHR] = {['='] = OPERATOR_SHR_ASSIGN},
+    [OPERATOR_BITWISE_AND] = {['&'] = OPERATOR_LOGICAL_AND, ['='] = OPERATOR_AND_ASSIGN},
+    [OPERATOR_BITWISE_OR] = {['|'] = OPERATOR_LOGICAL_OR, ['='] = OPERATOR_OR_ASSIGN},
+    [OPERATOR_BITWISE_XOR] = {['='] = OPERATOR_XOR_ASSIGN},
+    [OPERATOR_DOT] = {['.'] = OPERATOR_STATE_DOT_DOT},
+    [OPERATOR_STATE_DOT_DOT] = {['.'] = OPERATOR_ELLIPSIS}};
+
+// 最长匹配, 先在源码上往前看, 确定操作符后再把它读掉, 不需要push回去
+int read_op(struct lex_process *lexer)
+{
+    const char *start = lex_source_ptr(lexer);
+    const char *end = lexer->source.end;
+    int state = OPERATOR_NONE;
+    int op = OPERATOR_NONE;
+    size_t len = 0;
+    for (const char *ptr = start; ptr < end; ptr++)
     {
-        if (!op_valid(ptr))
+        state = operator_transitions[state][(unsigned char)*ptr];
+        if (state == OPERATOR_NONE)
+        {
+            break;
+        }
+        if (state != OPERATOR_STATE_DOT_DOT)
         {
-            read_op_flush_back_keep_first(buff);
-            ptr[1] = 0x00;
+            op = state;
+            len = ptr - start + 1;
         }
     }
-    else if (!op_valid(ptr))
+
+    if (op == OPERATOR_NONE)
+    {
+        lex_error(lexer, "The operator is not valid");
+    }
+    for (size_t i = 0; i < len; i++)
     {
-        compiler_error(lexer->compiler, "The operator %s is not valid", ptr);
+        nextc(lexer);
     }
-    return ptr;
+    return op;
 }
 
 // ( ( exp ) ) 处理多括号多表达式的情况
-static void lex_new_expression()
+static void lex_new_expression(struct lex_process *lexer)
 {
     lexer->current_expression_count++;
     if (lexer->current_expression_count == 1)
     {
-        lexer->parentheses_buffer = buffer_create();
+        // (30+2) '('已经读掉了
+        lexer->expression_start = lex_source_ptr(lexer) - lexer->source.start;
+        lexer->expression_first_token = lexer->tokens->count;
+    }
+}
+
+// 括号里的token的between_brackets都到end为止
+static void lex_close_expression_span(struct lex_process *lexer, const char *end)
+{
+    struct token_store *tokens = lexer->tokens;
+    uint32_t len = (end - lexer->source.start) - lexer->expression_start;
+    for (int i = lexer->expression_first_token; i < tokens->count; i++)
+    {
+        // 最外层的'('自己不在括号里
+        if (tokens->cold[i].between_brackets.offset)
+            tokens->cold[i].between_brackets.len = len;
     }
 }
 
-static void lex_finish_expression()
+static void lex_finish_expression(struct lex_process *lexer)
 {
     lexer->current_expression_count--;
     if (lexer->current_expression_count < 0)
     {
-        compiler_error(lexer->compiler, "You closed an expression that you never opened\n");
+        lex_error(lexer, "You closed an expression that you never opened\n");
+    }
+    if (lexer->current_expression_count == 0)
+    {
+        lex_close_expression_span(lexer, lex_source_ptr(lexer));
     }
 }
 
 // 判断我们是否在expression中
-bool lex_is_in_expression()
+bool lex_is_in_expression(struct lex_process *lexer)
 {
     return lexer->current_expression_count > 0;
 }
 
-bool is_keyword(const char *str)
+static struct token *token_make_operator_or_string(struct lex_process *lexer)
 {
-    return S_EQ(str, "unsigned") || S_EQ(str, "signed") || S_EQ(str, "char") || S_EQ(str, "short") ||
-           S_EQ(str, "int") || S_EQ(str, "float") || S_EQ(str, "double") || S_EQ(str, "long") ||
-           S_EQ(str, "void") || S_EQ(str, "struct") || S_EQ(str, "union") || S_EQ(str, "static") ||
-           S_EQ(str, "__ignore_typecheck__") || S_EQ(str, "return") || S_EQ(str, "include") ||
-           S_EQ(str, "sizeof") || S_EQ(str, "if") || S_EQ(str, "else") || S_EQ(str, "while") ||
-           S_EQ(str, "for") || S_EQ(str, "do") || S_EQ(str, "break") || S_EQ(str, "continue") ||
-           S_EQ(str, "switch") || S_EQ(str, "case") || S_EQ(str, "default") || S_EQ(str, "goto") ||
-           S_EQ(str, "typedef") || S_EQ(str, "const") || S_EQ(str, "extern") || S_EQ(str, "restrict");
-}
-
-static struct token *token_make_operator_or_string()
-{
-    char op = peekc();
+    char op = peekc(lexer);
     // #include<abc.h>
-    if (op == '<')
+    if (op == '<' && lex_last_token_is(lexer, TOKEN_TYPE_KEYWORLD, KEYWORD_INCLUDE))
     {
-        struct token *last_token = lex_last_token();
-        if (token_is_keyword(last_token, "include"))
-            return token_make_string('<', '>');
+        return token_make_string(lexer, '<', '>');
     }
-    struct token *token = token_create(&(struct token){.type = TOKEN_TYPE_OPERATOR, .sval = read_op()});
+    int type = read_op(lexer);
+    struct token *token = token_create(lexer, &(struct token){.type = TOKEN_TYPE_OPERATOR, .sval = operator_str(type), .op = type});
     if (op == '(')
     {
-        lex_new_expression();
+        lex_new_expression(lexer);
     }
     // ')' end
     return token;
 }
 
-struct token *token_make_one_line_comment()
+struct token *token_make_one_line_comment(struct lex_process *lexer)
 {
     // hello world
-    struct buffer *buff = buffer_create();
-    char c = 0;
-    LEX_GETC_IF(buff, c, (c != '\n' && c != EOF));
-    return token_create(&(struct token){.type = TOKEN_TYPE_COMMENT, .sval = buffer_ptr(buff)});
+    const char *start = lex_source_ptr(lexer);
+    const char *end = memchr(start, '\n', lexer->source.end - start);
+    lex_advance_to(lexer, end ? end : lexer->source.end);
+    return token_create(lexer, &(struct token){.type = TOKEN_TYPE_COMMENT, .sval = start, .slen = lex_source_ptr(lexer) - start});
 }
 
-struct token *token_make_multiline_comment()
+struct token *token_make_multiline_comment(struct lex_process *lexer)
 {
     /*
         hello world
     */
-    struct buffer *buff = buffer_create();
-    char c = 0;
-    // 循环去除/*******/
+    const char *start = lex_source_ptr(lexer);
+    const char *end = NULL;
+    // comment的内容为 /* 与 */ 之间的源码, 行号从srcloc算, 只需要找'*'
     while (1)
     {
-        LEX_GETC_IF(buff, c, (c != '*' && c != EOF));
-        if (c == EOF)
+        const char *star = memchr(lexer->source.cur, '*', lexer->source.end - lexer->source.cur);
+        if (!star)
         {
-            compiler_error(lexer->compiler, "You did not close this multiline comment");
+            lex_advance_to(lexer, lexer->source.end);
+            lex_error(lexer, "You did not close this multiline comment");
         }
-        else if (c == '*')
+        lex_advance_to(lexer, star + 1);
+        if (peekc(lexer) == '/')
         {
-            nextc();
-            if (peekc() == '/')
-            {
-                nextc();
-                break;
-            }
+            end = star;
+            nextc(lexer);
+            break;
         }
     }
-    return token_create(&(struct token){.type = TOKEN_TYPE_COMMENT, .sval = buffer_ptr(buff)});
+    return token_create(lexer, &(struct token){.type = TOKEN_TYPE_COMMENT, .sval = start, .slen = end - start});
 }
 
-struct token *handle_comment()
+// 当前字符是'/', 先看后面一个字符, 不是comment的话就是除号
+static struct token *handle_comment(struct lex_process *lexer)
 {
-    char c = peekc();
-    if (c == '/')
+    const char *cur = lexer->source.cur;
+    char c = cur + 1 < lexer->source.end ? cur[1] : EOF;
+    if (c != '/' && c != '*')
     {
-        nextc();
-        c = peekc();
-        if (c == '/')
-        {
-            nextc();
-            return token_make_one_line_comment();
-        }
-        else if (c == '*')
-        {
-            nextc();
-            return token_make_multiline_comment();
-        }
-        // 此时为 除号 '/'
-        pushc('/');
-        return token_make_operator_or_string();
+        return token_make_operator_or_string(lexer);
     }
 
-    return NULL;
+    nextc(lexer);
+    nextc(lexer);
+    if (c == '/')
+    {
+        return token_make_one_line_comment(lexer);
+    }
+    return token_make_multiline_comment(lexer);
 }
 
-static struct token *token_make_symbol()
+static struct token *token_make_symbol(struct lex_process *lexer)
 {
-    char c = peekc();
+    char c = peekc(lexer);
     if (c == ')')
     {
-        lex_finish_expression();
+        lex_finish_expression(lexer);
     }
-    c = nextc();
-    struct token *token = token_create(&(struct token){.type = TOKEN_TYPE_SYMBOL, .cval = c});
+    c = nextc(lexer);
+    struct token *token = token_create(lexer, &(struct token){.type = TOKEN_TYPE_SYMBOL, .cval = c});
     return token;
 }
 
-static struct token *token_make_identifier_or_keyword()
+static struct token *token_make_identifier_or_keyword(struct lex_process *lexer)
 {
-    struct buffer *buff = buffer_create();
-    char c = 0;
-    // isalnum()
-    LEX_GETC_IF(buff, c, ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || ('0' <= c && c <= '9') || (c == '_'));
-    buffer_write(buff, 0x00);
+    const char *start = lex_source_ptr(lexer);
+    // [A-Za-z0-9_]*
+    lex_advance_to(lexer, scan_identifier(start, lexer->source.end));
 
-    const char *str = buffer_ptr(buff);
+    size_t len = lex_source_ptr(lexer) - start;
     // 检查是否为keyword
-    if (is_keyword(str))
-    {
-        return token_create(&(struct token){.type = TOKEN_TYPE_KEYWORLD, .sval = str});
-    }
-    return token_create(&(struct token){.type = TOKEN_TYPE_IDENTIFIER, .sval = str});
-}
-
-struct token *read_special_token()
-{
-    char c = peekc();
-    if (isalpha(c) || c == '_')
+    int keyword = keyword_classify(start, len);
+    if (keyword != KEYWORD_NONE)
     {
-        return token_make_identifier_or_keyword();
+        return token_create(lexer, &(struct token){.type = TOKEN_TYPE_KEYWORLD, .sval = keyword_str(keyword), .slen = len, .keyword = keyword});
     }
-    return NULL;
+    const char *str = lex_intern(lexer, start, len);
+    return token_create(lexer, &(struct token){.type = TOKEN_TYPE_IDENTIFIER, .sval = str, .slen = len});
 }
 
-struct token *token_make_newline()
+struct token *token_make_newline(struct lex_process *lexer)
 {
-    nextc();
-    return token_create(&(struct token){.type = TOKEN_TYPE_NEWLINE});
+    nextc(lexer);
+    return token_create(lexer, &(struct token){.type = TOKEN_TYPE_NEWLINE});
 }
 
 char lex_get_excaped_char(char c)
@@ -409,164 +436,438 @@ char lex_get_excaped_char(char c)
     return co;
 }
 
-struct token *token_make_quote()
+struct token *token_make_quote(struct lex_process *lexer)
 {
     // '\n'
-    assert_next_char('\'');
-    char c = nextc();
+    assert_next_char(lexer, '\'');
+    char c = nextc(lexer);
     if (c == '\\')
     {
-        c = lex_get_excaped_char(nextc());
+        c = lex_get_excaped_char(nextc(lexer));
     }
-    if (nextc() != '\'')
+    if (nextc(lexer) != '\'')
     {
-        compiler_error(lexer->compiler, "You opened a quote ' but did not close it with a ' character ");
+        lex_error(lexer, "You opened a quote ' but did not close it with a ' character ");
     }
-    return token_create(&(struct token){.type = TOKEN_TYPE_NUMBER, .cval = c});
+    return token_create(lexer, &(struct token){.type = TOKEN_TYPE_NUMBER, .cval = c});
 }
 
-const char *read_hex_number_str()
+const char *read_hex_number_str(struct lex_process *lexer, size_t *len)
 {
-    struct buffer *buff = buffer_create();
+    const char *start = lex_source_ptr(lexer);
     char c = 0;
-    LEX_GETC_IF(buff, c, ('a' <= c && c <= 'f') || ('A' <= c && c <= 'F') || ('0' <= c && c <= '9'));
-    buffer_write(buff, 0x00);
-    return buffer_ptr(buff);
+    LEX_SKIP_IF(c, ('a' <= c && c <= 'f') || ('A' <= c && c <= 'F') || ('0' <= c && c <= '9'));
+    *len = lex_source_ptr(lexer) - start;
+    return start;
 }
 
-struct token *token_make_special_number_hexadecimal()
+struct token *token_make_special_number_hexadecimal(struct lex_process *lexer)
 {
-    nextc(); // 跳过'x'
+    nextc(lexer); // 跳过'x'
+    size_t len = 0;
+    const char *str = read_hex_number_str(lexer, &len);
+    // 转换16位number字符串为long
     unsigned long number = 0;
-    const char *str = read_hex_number_str();
-    number = strtol(str, NULL, 16); // 转换16位number字符串为long
-    return token_make_number_for_value(number);
+    for (size_t i = 0; i < len; i++)
+    {
+        char c = str[i];
+        int digit = c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+        number = number * 16 + digit;
+    }
+    return token_make_number_for_value(lexer, number);
 }
 
-void lex_validate_binary_string(const char *str)
+void lex_validate_binary_string(struct lex_process *lexer, const char *str, size_t slen)
 {
-    size_t slen = strlen(str);
-    for (int i = 0; i < slen; i++)
+    for (size_t i = 0; i < slen; i++)
     {
         if (str[i] != '0' && str[i] != '1')
         {
-            compiler_error(lexer->compiler, "This is not a valid binary number");
+            lex_error(lexer, "This is not a valid binary number");
         }
     }
 }
 
-struct token *token_make_special_number_binary()
+struct token *token_make_special_number_binary(struct lex_process *lexer)
 {
-    nextc(); // 跳过'b'
-    const char *number_str = read_number_str();
-    lex_validate_binary_string(number_str);
-    unsigned long number = strtol(number_str, 0, 2);
-    return token_make_number_for_value(number);
+    nextc(lexer); // 跳过'b'
+    size_t len = 0;
+    const char *number_str = read_number_str(lexer, &len);
+    lex_validate_binary_string(lexer, number_str, len);
+    unsigned long number = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        number = number * 2 + (number_str[i] - '0');
+    }
+    return token_make_number_for_value(lexer, number);
 }
 
-struct token *token_make_special_number()
+struct token *token_make_special_number(struct lex_process *lexer)
 {
     struct token *token = NULL;
-    struct token *last_token = lex_last_token();
-    if (!last_token || last_token->type != TOKEN_TYPE_NUMBER || last_token->llnum != 0)
+    if (!lex_last_token_is(lexer, TOKEN_TYPE_NUMBER, 0))
     {
-        return token_make_identifier_or_keyword();
+        return token_make_identifier_or_keyword(lexer);
     }
-    lex_pop_token();
+    // 0x12 从'0'开始
+    lexer->token_start = lexer->source.start + lexer->tokens->offset[lex_last_token(lexer)];
+    lex_pop_token(lexer);
 
-    char c = peekc();
+    char c = peekc(lexer);
     if (c == 'x')
     {
-        token = token_make_special_number_hexadecimal();
+        token = token_make_special_number_hexadecimal(lexer);
     }
     else if (c == 'b')
     {
-        token = token_make_special_number_binary();
+        token = token_make_special_number_binary(lexer);
     }
 
     return token;
 }
 
-struct token *read_next_token()
-{
+// read_next_token按token第一个字符的种类分发
+enum
+{
+    LEX_CLASS_INVALID,
+    LEX_CLASS_BLANK,
+    LEX_CLASS_NEWLINE,
+    LEX_CLASS_DIGIT,
+    LEX_CLASS_IDENTIFIER,
+    // b和x可能是0b/0x数字的一部分
+    LEX_CLASS_NUMBER_PREFIX,
+    LEX_CLASS_OPERATOR,
+    // 除号或者comment
+    LEX_CLASS_SLASH,
+    LEX_CLASS_SYMBOL,
+    LEX_CLASS_STRING,
+    LEX_CLASS_QUOTE,
+    LEX_CLASS_COUNT
+};
+
+static const unsigned char lex_char_class[256] = {
+    [' '] = LEX_CLASS_BLANK, ['\t'] = LEX_CLASS_BLANK, ['\n'] = LEX_CLASS_NEWLINE,
+    ['0'] = LEX_CLASS_DIGIT, ['1'] = LEX_CLASS_DIGIT, ['2'] = LEX_CLASS_DIGIT, ['3'] = LEX_CLASS_DIGIT, ['4'] = LEX_CLASS_DIGIT,
+    ['5'] = LEX_CLASS_DIGIT, ['6'] = LEX_CLASS_DIGIT, ['7'] = LEX_CLASS_DIGIT, ['8'] = LEX_CLASS_DIGIT, ['9'] = LEX_CLASS_DIGIT,
+    ['A'] = LEX_CLASS_IDENTIFIER, ['B'] = LEX_CLASS_IDENTIFIER, ['C'] = LEX_CLASS_IDENTIFIER, ['D'] = LEX_CLASS_IDENTIFIER,
+    ['E'] = LEX_CLASS_IDENTIFIER, ['F'] = LEX_CLASS_IDENTIFIER, ['G'] = LEX_CLASS_IDENTIFIER, ['H'] = LEX_CLASS_IDENTIFIER,
+    ['I'] = LEX_CLASS_IDENTIFIER, ['J'] = LEX_CLASS_IDENTIFIER, ['K'] = LEX_CLASS_IDENTIFIER, ['L'] = LEX_CLASS_IDENTIFIER,
+    ['M'] = LEX_CLASS_IDENTIFIER, ['N'] = LEX_CLASS_IDENTIFIER, ['O'] = LEX_CLASS_IDENTIFIER, ['P'] = LEX_CLASS_IDENTIFIER,
+    ['Q'] = LEX_CLASS_IDENTIFIER, ['R'] = LEX_CLASS_IDENTIFIER, ['S'] = LEX_CLASS_IDENTIFIER, ['T'] = LEX_CLASS_IDENTIFIER,
+    ['U'] = LEX_CLASS_IDENTIFIER, ['V'] = LEX_CLASS_IDENTIFIER, ['W'] = LEX_CLASS_IDENTIFIER, ['X'] = LEX_CLASS_IDENTIFIER,
+    ['Y'] = LEX_CLASS_IDENTIFIER, ['Z'] = LEX_CLASS_IDENTIFIER, ['_'] = LEX_CLASS_IDENTIFIER,
+    ['a'] = LEX_CLASS_IDENTIFIER, ['b'] = LEX_CLASS_NUMBER_PREFIX, ['c'] = LEX_CLASS_IDENTIFIER, ['d'] = LEX_CLASS_IDENTIFIER,
+    ['e'] = LEX_CLASS_IDENTIFIER, ['f'] = LEX_CLASS_IDENTIFIER, ['g'] = LEX_CLASS_IDENTIFIER, ['h'] = LEX_CLASS_IDENTIFIER,
+    ['i'] = LEX_CLASS_IDENTIFIER, ['j'] = LEX_CLASS_IDENTIFIER, ['k'] = LEX_CLASS_IDENTIFIER, ['l'] = LEX_CLASS_IDENTIFIER,
+    ['m'] = LEX_CLASS_IDENTIFIER, ['n'] = LEX_CLASS_IDENTIFIER, ['o'] = LEX_CLASS_IDENTIFIER, ['p'] = LEX_CLASS_IDENTIFIER,
+    ['q'] = LEX_CLASS_IDENTIFIER, ['r'] = LEX_CLASS_IDENTIFIER, ['s'] = LEX_CLASS_IDENTIFIER, ['t'] = LEX_CLASS_IDENTIFIER,
+    ['u'] = LEX_CLASS_IDENTIFIER, ['v'] = LEX_CLASS_IDENTIFIER, ['w'] = LEX_CLASS_IDENTIFIER, ['x'] = LEX_CLASS_NUMBER_PREFIX,
+    ['y'] = LEX_CLASS_IDENTIFIER, ['z'] = LEX_CLASS_IDENTIFIER,
+    ['+'] = LEX_CLASS_OPERATOR, ['-'] = LEX_CLASS_OPERATOR, ['*'] = LEX_CLASS_OPERATOR, ['<'] = LEX_CLASS_OPERATOR,
+    ['>'] = LEX_CLASS_OPERATOR, ['^'] = LEX_CLASS_OPERATOR, ['%'] = LEX_CLASS_OPERATOR, ['!'] = LEX_CLASS_OPERATOR,
+    ['='] = LEX_CLASS_OPERATOR, ['~'] = LEX_CLASS_OPERATOR, ['|'] = LEX_CLASS_OPERATOR, ['&'] = LEX_CLASS_OPERATOR,
+    ['('] = LEX_CLASS_OPERATOR, ['['] = LEX_CLASS_OPERATOR, [','] = LEX_CLASS_OPERATOR, ['.'] = LEX_CLASS_OPERATOR,
+    ['?'] = LEX_CLASS_OPERATOR, ['/'] = LEX_CLASS_SLASH,
+    ['{'] = LEX_CLASS_SYMBOL, ['}'] = LEX_CLASS_SYMBOL, [':'] = LEX_CLASS_SYMBOL, [';'] = LEX_CLASS_SYMBOL,
+    ['#'] = LEX_CLASS_SYMBOL, ['\\'] = LEX_CLASS_SYMBOL, [')'] = LEX_CLASS_SYMBOL, [']'] = LEX_CLASS_SYMBOL,
+    ['"'] = LEX_CLASS_STRING, ['\''] = LEX_CLASS_QUOTE};
+
+// GCC下用computed goto直接跳到处理函数, 否则退回switch
+#ifdef __GNUC__
+#define LEX_DISPATCH(class) goto *lex_dispatch[class];
+#define LEX_CASE(class, label) label
+#else
+#define LEX_DISPATCH(class) switch (class)
+#define LEX_CASE(class, label) case class
+#endif
+
+// 每读出一个token打印一条, 和原来直接printf的输出一样
+#define LEX_TRACE_TOKEN(lexer, ...) TRACE((lexer)->compiler, TRACE_LEX, TRACE_LEVEL_DEBUG, __VA_ARGS__)
+
+struct token *read_next_token(struct lex_process *lexer)
+{
+#ifdef __GNUC__
+    static const void *lex_dispatch[LEX_CLASS_COUNT] = {
+        [LEX_CLASS_INVALID] = &&lex_invalid,
+        [LEX_CLASS_BLANK] = &&lex_blank,
+        [LEX_CLASS_NEWLINE] = &&lex_newline,
+        [LEX_CLASS_DIGIT] = &&lex_digit,
+        [LEX_CLASS_IDENTIFIER] = &&lex_identifier,
+        [LEX_CLASS_NUMBER_PREFIX] = &&lex_number_prefix,
+        [LEX_CLASS_OPERATOR] = &&lex_operator,
+        [LEX_CLASS_SLASH] = &&lex_slash,
+        [LEX_CLASS_SYMBOL] = &&lex_symbol,
+        [LEX_CLASS_STRING] = &&lex_string,
+        [LEX_CLASS_QUOTE] = &&lex_quote};
+#endif
     struct token *token = NULL;
-    char c = peekc();
 
-    token = handle_comment();
-    if (token)
+next:
+    if (lexer->source.cur >= lexer->source.end)
     {
-        printf("%s ", token->sval);
-        return token;
+        // 读取结束, 没有关上的括号一直到文件末尾
+        if (lex_is_in_expression(lexer))
+            lex_close_expression_span(lexer, lexer->source.end);
+        return NULL;
     }
-
-    switch (c)
+    lexer->token_start = lexer->source.cur;
+    LEX_DISPATCH(lex_char_class[(unsigned char)*lexer->source.cur])
     {
-    NUMERIC_CASE:
-        token = token_make_number();
-        printf("%lld ", token->llnum);
-        break;
-    OPERATOR_CASE_EXCLUDING_DIVISION:
-        token = token_make_operator_or_string();
-        printf("%s ", token->sval);
-        break;
-    SYMBOL_CASE:
-        token = token_make_symbol();
-        printf("%c ", token->cval);
-        break;
-    case 'b':
-    case 'x':
-        token = token_make_special_number();
+    LEX_CASE(LEX_CLASS_BLANK, lex_blank):
+        // 空格不产生token, 一次跳过一整段之后接着读
+        if (lex_last_token(lexer) >= 0)
+            lexer->tokens->cold[lex_last_token(lexer)].whitespace = true;
+        lex_advance_to(lexer, scan_blank(lexer->source.cur, lexer->source.end));
+        goto next;
+    LEX_CASE(LEX_CLASS_NEWLINE, lex_newline):
+        token = token_make_newline(lexer);
+        LEX_TRACE_TOKEN(lexer, "\n");
+        goto done;
+    LEX_CASE(LEX_CLASS_DIGIT, lex_digit):
+        token = token_make_number(lexer);
+        LEX_TRACE_TOKEN(lexer, "%lld ", token->llnum);
+        goto done;
+    LEX_CASE(LEX_CLASS_IDENTIFIER, lex_identifier):
+        token = token_make_identifier_or_keyword(lexer);
+        LEX_TRACE_TOKEN(lexer, "%s ", token->sval);
+        goto done;
+    LEX_CASE(LEX_CLASS_NUMBER_PREFIX, lex_number_prefix):
+        token = token_make_special_number(lexer);
         if (token->type == TOKEN_TYPE_IDENTIFIER || token->type == TOKEN_TYPE_KEYWORLD)
-            printf("%s ", token->sval);
+            LEX_TRACE_TOKEN(lexer, "%s ", token->sval);
         else
-            printf("%lld ", token->llnum);
-        break;
-    case '"':
-        token = token_make_string('"', '"');
-        printf("%s ", token->sval);
-        break;
-    case '\'':
-        token = token_make_quote();
-        printf("%c ", token->cval);
-        break;
-    case ' ':
-    case '\t':
-        token = handle_whitespace();
-        break;
-    case '\n':
-        token = token_make_newline();
-        printf("\n");
-        break;
-    case EOF:
-        // 读取结束
-        break;
-    default:
-        token = read_special_token();
+            LEX_TRACE_TOKEN(lexer, "%lld ", token->llnum);
+        goto done;
+    LEX_CASE(LEX_CLASS_OPERATOR, lex_operator):
+        token = token_make_operator_or_string(lexer);
+        LEX_TRACE_TOKEN(lexer, "%s ", token->sval);
+        goto done;
+    LEX_CASE(LEX_CLASS_SLASH, lex_slash):
+        token = handle_comment(lexer);
+        LEX_TRACE_TOKEN(lexer, "%.*s ", (int)token->slen, token->sval);
+        goto done;
+    LEX_CASE(LEX_CLASS_SYMBOL, lex_symbol):
+        token = token_make_symbol(lexer);
+        LEX_TRACE_TOKEN(lexer, "%c ", token->cval);
+        goto done;
+    LEX_CASE(LEX_CLASS_STRING, lex_string):
+        token = token_make_string(lexer, '"', '"');
+        LEX_TRACE_TOKEN(lexer, "%s ", token->sval);
+        goto done;
+    LEX_CASE(LEX_CLASS_QUOTE, lex_quote):
+        token = token_make_quote(lexer);
+        LEX_TRACE_TOKEN(lexer, "%c ", token->cval);
+        goto done;
+    LEX_CASE(LEX_CLASS_INVALID, lex_invalid):
+        lex_error(lexer, "Unexpected token!");
+    }
+
+done:
+    return token;
+}
+
+int lex(struct lex_process *lexer)
+{
+    lexer->current_expression_count = 0;
+    if (!lexer->source.start)
+    {
+        lex_process_read_source(lexer);
+    }
+    // 行号和列号只在报错时才从文件里算出来
+    struct compile_process *compiler = lexer->compiler;
+    lexer->file = source_file_add(compiler, compiler->ifile.abs_path, lexer->source.start, lexer->source.end - lexer->source.start);
+    lexer->tokens->base = source_file_get(compiler, lexer->file)->base;
+
+    struct token *token = read_next_token(lexer);
+    while (token)
+    {
+        token_store_push(lexer->tokens, token);
+        token = read_next_token(lexer);
+    }
+    TRACE(compiler, TRACE_LEX, TRACE_LEVEL_DEBUG, "\n");
+    return LEXICAL_ANALYSIS_ALL_OK;
+}
+
+// 第一个offset >= offset的token
+static int lex_token_lower_bound(struct token_store *tokens, size_t offset)
+{
+    int low = 0;
+    int high = tokens->count;
+    while (low < high)
+    {
+        int mid = low + (high - low) / 2;
+        if (token_store_offset(tokens, mid) < offset)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+// token开始的时候不在括号表达式里, ')'在创建token之前就已经结束了表达式
+static bool lex_token_at_top_level(struct token_store *tokens, int index)
+{
+    int slot = token_store_slot(tokens, index);
+    return !tokens->cold[slot].between_brackets.offset && !(tokens->type[slot] == TOKEN_TYPE_SYMBOL && tokens->value[slot] == ')');
+}
+
+// 前一个token会影响下一个token怎么lex: 0后面的x/b, include后面的<
+static bool lex_token_affects_next(struct token_store *tokens, int index)
+{
+    int slot = token_store_slot(tokens, index);
+    int type = tokens->type[slot];
+    uint32_t value = tokens->value[slot];
+    return (type == TOKEN_TYPE_KEYWORLD && value == KEYWORD_INCLUDE) || (type == TOKEN_TYPE_NUMBER && value == 0);
+}
+
+static bool lex_token_equal(struct token *a, struct token *b)
+{
+    if (a->type != b->type || a->flags != b->flags || a->slen != b->slen)
+    {
+        return false;
+    }
+
+    switch (a->type)
+    {
+    case TOKEN_TYPE_KEYWORLD:
+        return a->keyword == b->keyword;
+    case TOKEN_TYPE_OPERATOR:
+        return a->op == b->op;
+    case TOKEN_TYPE_IDENTIFIER:
+    case TOKEN_TYPE_STRING:
+        // 都是intern过的
+        return a->sval == b->sval;
+    case TOKEN_TYPE_COMMENT:
+        return true;
+    case TOKEN_TYPE_NUMBER:
+        return a->llnum == b->llnum && a->num.type == b->num.type;
+    }
+    return a->llnum == b->llnum;
+}
+
+struct lex_edit
+{
+    size_t start;
+    // edit在修改前和修改后结束的位置
+    size_t old_end;
+    size_t new_end;
+    ptrdiff_t delta;
+    // 从这个下标的token开始重新lex
+    int restart;
+};
+
+// 新token和旧token在同样的(平移后)位置开始, 内容也一样
+static bool lex_relex_matches(struct token *token, struct token_store *old, int index, struct lex_edit *edit)
+{
+    if (index >= old->count || token->offset - edit->delta != token_store_offset(old, index))
+    {
+        return false;
+    }
+    struct token old_token;
+    token_store_get(old, index, &old_token);
+    return lex_token_equal(token, &old_token);
+}
+
+// 从edit之前最近的安全位置开始lex, 和旧的token重新对齐之后停下
+static void lex_relex_tokens(struct lex_process *lexer, struct token_store *old, struct lex_edit *edit)
+{
+    struct token_store *fresh = lexer->tokens;
+    int count = old->count;
+    int sync = lex_token_lower_bound(old, edit->old_end);
+    // 和old[sync]对齐的新token, 要等下一个token也对齐才算数, 比如 0 后面的x会把它变成0x
+    bool candidate = false;
+    while (1)
+    {
+        bool top_level = !lex_is_in_expression(lexer);
+        struct token *token = read_next_token(lexer);
+        if (candidate)
+        {
+            if (token ? lex_relex_matches(token, old, sync + 1, edit) : sync + 1 == count)
+            {
+                token_store_pop(fresh);
+                break;
+            }
+            candidate = false;
+        }
         if (!token)
         {
-            compiler_error(lexer->compiler, "Unexpected token!");
+            sync = count;
+            break;
         }
-        printf("%s ", token->sval);
+        // edit之后的源码没有变, 位置, 括号状态和token都一样的话之后的token也一样
+        if (top_level && token->offset >= edit->new_end)
+        {
+            size_t old_offset = token->offset - edit->delta;
+            while (sync < count && token_store_offset(old, sync) < old_offset)
+                sync++;
+            candidate = lex_relex_matches(token, old, sync, edit) && lex_token_at_top_level(old, sync);
+        }
+        token_store_push(fresh, token);
     }
 
-    return token;
+    // 对齐之后的旧token在tail里, 它们离源码末尾的距离没有变, 不用改
+    token_store_splice(old, edit->restart, sync - edit->restart, fresh, edit->delta);
 }
 
-int lex(struct lex_process *process)
+int lex_relex(struct lex_process *lexer, size_t start, size_t end, const char *text, size_t len)
 {
-    process->current_expression_count = 0;
-    process->parentheses_buffer = NULL;
-    process->pos.filename = process->compiler->ifile.abs_path;
-    lexer = process;
-
-    struct token *token = read_next_token();
-    while (token)
+    size_t size = lexer->source.end - lexer->source.start;
+    if (start > end || end > size)
+    {
+        return LEXICAL_ANALYSIS_INPUT_ERROR;
+    }
+    struct lex_edit edit = {.start = start, .old_end = end, .new_end = start + len, .delta = (ptrdiff_t)len - (ptrdiff_t)(end - start)};
+    struct compile_process *compiler = lexer->compiler;
+    struct token_store *tokens = lexer->tokens;
+    // 有tail时end一直是源码的长度
+    if (!tokens->tail)
+        tokens->end = size;
+
+    // edit之前的token再往前退一个, 比如 .. 后面加一个. 会变成 ...
+    int restart = lex_token_lower_bound(tokens, start) - 2;
+    while (restart > 0 && (!lex_token_at_top_level(tokens, restart) || lex_token_affects_next(tokens, restart - 1)))
+        restart--;
+    if (restart < 0)
+        restart = 0;
+    edit.restart = restart;
+
+    // 源码和token的gap都停在restart, 退到第一个token时从头开始
+    lex_process_splice_source(lexer, start, end, text, len, restart > 0 ? token_store_offset(tokens, restart) : 0);
+    token_store_move_gap(tokens, restart);
+    const char *base = lexer->source.start;
+    tokens->base = source_file_get(compiler, lexer->file)->base;
+    tokens->source = lexer->edit_source.data;
+    tokens->tail_source = base;
+    lexer->current_expression_count = 0;
+
+    // 新的token先放在单独的store里, 对齐之后再替换掉旧的
+    lexer->tokens = token_store_create(tokens->strings);
+    lexer->tokens->source = base;
+    lexer->tokens->base = tokens->base;
+    jmp_buf outer_jmp;
+    bool outer_jmp_set = compiler->error_jmp_set;
+    if (outer_jmp_set)
+        memcpy(outer_jmp, compiler->error_jmp, sizeof(jmp_buf));
+
+    int res = LEXICAL_ANALYSIS_ALL_OK;
+    compiler->error_jmp_set = true;
+    if (setjmp(compiler->error_jmp) == 0)
     {
-        vector_push(lexer->token_vec, token);
-        token = read_next_token();
+        lex_relex_tokens(lexer, tokens, &edit);
     }
-    printf("\n");
-    return LEXICAL_ANALYSIS_ALL_OK;
+    else
+    {
+        // 出错的位置之后的token都不可信, 只保留前面的
+        res = LEXICAL_ANALYSIS_INPUT_ERROR;
+        token_store_splice(tokens, edit.restart, tokens->count - edit.restart, NULL, edit.delta);
+    }
+    compiler->error_jmp_set = outer_jmp_set;
+    if (outer_jmp_set)
+        memcpy(compiler->error_jmp, outer_jmp, sizeof(jmp_buf));
+
+    token_store_free(lexer->tokens);
+    lexer->tokens = tokens;
+    return res;
 }
 
 char lexer_string_buffer_peek_char(struct lex_process *process)
@@ -595,11 +896,12 @@ struct lex_process_functions lexer_string_buffer_functions = {
 struct lex_process *token_build_for_string(struct compile_process *compiler, const char *str)
 {
     struct buffer *buff = buffer_create();
-    buffer_printf(buff, str);
+    buffer_write_n(buff, str, strlen(str));
     struct lex_process *lex_process = lex_process_create(compiler, &lexer_string_buffer_functions, buff);
     if (!lex_process)
     {
         return NULL;
     }
+    lex_process_set_source(lex_process, buffer_ptr(buff), buff->len);
     return lex_process;
 }
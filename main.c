@@ -1,14 +1,31 @@
 #include<stdio.h>
 #include"compiler.h"
+#include"helpers/buffer.h"
 
-int main()
+int main(int argc, const char** argv)
 {
-    int res = compile_file("./test.c", "./test", 0);
-    if(res == COMPILER_FILE_COMPILED_OK)
-        printf("Everything compiled OK\n");
-    else if(res == COMPILER_FAILED_WITH_ERROR)
-        printf("Compile failed\n");
-    else
-        printf("Unknown response for compile file\n");
-    return 0;
-}
\ No newline at end of file
+    if (argc > 1 && S_EQ(argv[1], "--server"))
+    {
+        return server_main(argc > 2 ? argv[2] : server_default_socket_path());
+    }
+
+    if (argc > 1 && S_EQ(argv[1], "--client"))
+    {
+        int res = client_main(server_default_socket_path(), argc - 2, argv + 2);
+        if (res >= 0)
+            return res;
+
+        // No server running, compile here instead
+        argc--;
+        argv++;
+    }
+
+    struct buffer* out = buffer_create();
+    struct buffer* err = buffer_create();
+    int res = driver_main(argc - 1, argv + 1, NULL, NULL, out, err);
+    fwrite(buffer_ptr(err), 1, err->len, stderr);
+    fwrite(buffer_ptr(out), 1, out->len, stdout);
+    buffer_free(out);
+    buffer_free(err);
+    return res;
+}
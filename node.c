@@ -1,49 +1,249 @@
 #include "compiler.h"
 #include <assert.h>
 #include "helpers/vector.h"
+#include "helpers/intern.h"
 
-struct vector *node_vector = NULL;
-struct vector *node_vector_root = NULL;
+VECTOR_DEFINE_TYPED(node_vec, node_id)
 
-void node_set_vector(struct vector *vec, struct vector *vec_root)
+// 第一次创建node时分配的数量
+#define NODE_STORE_INITIAL_CAPACITY 1024
+
+struct node_store *node_store_create()
+{
+    struct node_store *store = calloc(1, sizeof(struct node_store));
+    node_store_clear(store);
+    return store;
+}
+
+void node_store_free(struct node_store *store)
+{
+    free(store->nodes);
+    free(store->last_child);
+    free(store->wide);
+    free(store);
+}
+
+static void node_store_reserve(struct node_store *store, int count)
 {
-    node_vector = vec;
-    node_vector_root = vec_root;
+    if (count <= store->capacity)
+    {
+        return;
+    }
+    int capacity = store->capacity ? store->capacity : NODE_STORE_INITIAL_CAPACITY;
+    while (capacity < count)
+        capacity *= 2;
+    store->nodes = realloc(store->nodes, capacity * sizeof(*store->nodes));
+    store->last_child = realloc(store->last_child, capacity * sizeof(*store->last_child));
+    store->capacity = capacity;
+    store->allocated += capacity * (sizeof(*store->nodes) + sizeof(*store->last_child));
 }
 
-void node_push(struct node *node)
+void node_store_clear(struct node_store *store)
 {
-    vector_push(node_vector, &node);
+    node_store_reserve(store, NODE_ROOT + 1);
+    // 下标0不用, 这样0可以表示没有
+    memset(store->nodes, 0, (NODE_ROOT + 1) * sizeof(*store->nodes));
+    memset(store->last_child, 0, (NODE_ROOT + 1) * sizeof(*store->last_child));
+    store->nodes[NODE_ROOT].type = NODE_TYPE_ROOT;
+    store->count = NODE_ROOT + 1;
+    store->wide_count = 0;
 }
 
-struct node *node_peek_or_null()
+size_t node_store_bytes(struct node_store *store)
 {
-    return vector_back_ptr_or_null(node_vector);
+    return store->allocated;
 }
 
-struct node *node_peek()
+int node_count(struct compile_process *process)
 {
-    return *(struct node **)vector_back(node_vector);
+    return process->nodes->count - (NODE_ROOT + 1);
 }
 
-struct node *node_pop()
+struct node *node_at(struct compile_process *process, node_id id)
 {
-    struct node *last_node = vector_back_ptr(node_vector);
-    struct node *last_node_root = vector_empty(node_vector_root) ? NULL : vector_back_ptr(node_vector_root);
-    vector_pop(node_vector);
+    assert(id != NODE_NONE && id < (node_id)process->nodes->count);
+    return &process->nodes->nodes[id];
+}
+
+void node_push(struct compile_process *process, node_id id)
+{
+    node_vec_push(process->node_vec, id);
+}
+
+node_id node_peek_or_null(struct compile_process *process)
+{
+    node_id *id = node_vec_back(process->node_vec);
+    return id ? *id : NODE_NONE;
+}
+
+node_id node_peek(struct compile_process *process)
+{
+    return *(node_id *)vector_back(process->node_vec);
+}
 
-    if (last_node == last_node_root)
+node_id node_pop(struct compile_process *process)
+{
+    node_id id = node_peek(process);
+    vector_pop(process->node_vec);
+    return id;
+}
+
+node_id node_create(struct compile_process *process, struct node *_node)
+{
+    struct node_store *store = process->nodes;
+    node_store_reserve(store, store->count + 1);
+    node_id id = store->count++;
+    // 最后读掉的token的位置
+    store->nodes[id] = (struct node){.type = _node->type, .flag = _node->flag, .loc = process->loc, .value = _node->value};
+    store->last_child[id] = NODE_NONE;
+    if (TRACE_ENABLED(process, TRACE_NODE, TRACE_LEVEL_DEBUG))
+    {
+        struct pos pos = srcloc_resolve(process, process->loc);
+        trace_printf(process, "node type %i on line %i, col %i\n", _node->type, pos.line, pos.col);
+    }
+    node_push(process, id);
+    return id;
+}
+
+void node_append_child(struct compile_process *process, node_id parent, node_id child)
+{
+    struct node_store *store = process->nodes;
+    struct node *node = node_at(process, child);
+    assert(node->parent == NODE_NONE && child != parent);
+    node->parent = parent;
+    node_id last = store->last_child[parent];
+    if (last)
+        store->nodes[last].next_sibling = child;
+    else
+        store->nodes[parent].first_child = child;
+    store->last_child[parent] = child;
+}
+
+void node_mark(struct compile_process *process, struct node_mark *mark)
+{
+    mark->stack = vector_count(process->node_vec);
+    mark->count = process->nodes->count;
+    mark->wide_count = process->nodes->wide_count;
+}
+
+// mark之前的node没有被接到新node下面, 也没有接上新的子节点, 否则回退后它们的链接指向被丢掉的node
+// 只有mark之后的node会动到这些链接, 所以只看它们: parent和子节点都不能是mark之前的node
+static bool node_mark_untouched(struct compile_process *process, struct node_mark *mark)
+{
+    struct node *nodes = process->nodes->nodes;
+    node_id first = mark->count;
+    for (node_id id = first; id < (node_id)process->nodes->count; id++)
     {
-        vector_pop(node_vector_root);
+        if (nodes[id].parent != NODE_NONE && nodes[id].parent < first)
+        {
+            return false;
+        }
+        for (node_id child = nodes[id].first_child; child; child = nodes[child].next_sibling)
+        {
+            if (child < first)
+                return false;
+        }
     }
-    return last_node;
+    return true;
+}
+
+void node_rewind(struct compile_process *process, struct node_mark *mark)
+{
+    int stack = vector_count(process->node_vec);
+    assert(stack >= mark->stack && process->nodes->count >= mark->count);
+    assert(node_mark_untouched(process, mark));
+    vector_splice(process->node_vec, mark->stack, stack - mark->stack, NULL, 0);
+    process->nodes->count = mark->count;
+    process->nodes->wide_count = mark->wide_count;
 }
 
-struct node *node_create(struct node *_node)
+uint32_t node_number_value(struct compile_process *process, unsigned long long number)
 {
-    struct node *node = malloc(sizeof(struct node));
-    memcpy(node, _node, sizeof(struct node));
-#warning "We should set the binded owner and binded function here"
-    node_push(node);
-    return node;
-}
\ No newline at end of file
+    struct node_store *store = process->nodes;
+    if (number < TOKEN_VALUE_WIDE)
+    {
+        return number;
+    }
+    if (store->wide_count == store->wide_capacity)
+    {
+        store->wide_capacity = store->wide_capacity ? store->wide_capacity * 2 : 16;
+        store->wide = realloc(store->wide, store->wide_capacity * sizeof(*store->wide));
+        store->allocated += store->wide_capacity * sizeof(*store->wide);
+    }
+    store->wide[store->wide_count] = number;
+    return TOKEN_VALUE_WIDE | store->wide_count++;
+}
+
+unsigned long long node_number(struct compile_process *process, node_id id)
+{
+    uint32_t value = node_at(process, id)->value;
+    if (value & TOKEN_VALUE_WIDE)
+    {
+        return process->nodes->wide[value & ~TOKEN_VALUE_WIDE];
+    }
+    return value;
+}
+
+const char *node_sval(struct compile_process *process, node_id id)
+{
+    return intern_at(process->strings, node_at(process, id)->value);
+}
+
+// id的子树之后的下一个node: 自己或者祖先的下一个兄弟, 到root为止
+static node_id node_walk_after(struct node_walk *walk, node_id id)
+{
+    struct node *nodes = walk->store->nodes;
+    while (id != walk->root)
+    {
+        if (nodes[id].next_sibling)
+            return nodes[id].next_sibling;
+        id = nodes[id].parent;
+    }
+    return NODE_NONE;
+}
+
+// 后序遍历时第一个访问的node: 一直往第一个子节点走到叶子
+static node_id node_walk_leftmost_leaf(struct node_walk *walk, node_id id)
+{
+    struct node *nodes = walk->store->nodes;
+    while (nodes[id].first_child)
+        id = nodes[id].first_child;
+    return id;
+}
+
+void node_walk_begin(struct node_walk *walk, struct compile_process *process, node_id root, int order)
+{
+    *walk = (struct node_walk){.store = process->nodes, .root = root, .order = order};
+    walk->next = order == NODE_WALK_POSTORDER ? node_walk_leftmost_leaf(walk, root) : root;
+}
+
+node_id node_walk_next(struct node_walk *walk)
+{
+    node_id id = walk->next;
+    walk->current = id;
+    if (!id)
+    {
+        return NODE_NONE;
+    }
+
+    struct node *node = &walk->store->nodes[id];
+    if (walk->order == NODE_WALK_POSTORDER)
+    {
+        if (id == walk->root)
+            walk->next = NODE_NONE;
+        else if (node->next_sibling)
+            walk->next = node_walk_leftmost_leaf(walk, node->next_sibling);
+        else
+            walk->next = node->parent;
+        return id;
+    }
+
+    walk->next = node->first_child ? node->first_child : node_walk_after(walk, id);
+    return id;
+}
+
+void node_walk_skip_children(struct node_walk *walk)
+{
+    assert(walk->order == NODE_WALK_PREORDER && walk->current);
+    walk->next = node_walk_after(walk, walk->current);
+}
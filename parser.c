@@ -1,102 +1,861 @@
 #include "compiler.h"
 #include "helpers/vector.h"
+#include "helpers/intern.h"
 
-struct compile_process *current_compiler;
-static struct token *parser_last_token;
-
-static void parse_ignore_nl_or_comment(struct token *token)
+// 跳过换行和comment, 只看token的type和value. 返回下一个token的下标, 没有了返回-1
+static int parse_ignore_nl_or_comment(struct compile_process *process)
 {
-    while (token && token_is_nl_or_comment_or_newline_seperator(token))
+    struct token_store *tokens = process->tokens;
+    int index = process->parser.index;
+    while (index < tokens->count && token_store_is_nl_or_comment_or_newline_seperator(tokens, index))
     {
-        vector_peek(current_compiler->token_vec);
-        token = vector_peek_no_increment(current_compiler->token_vec);
+        index++;
     }
+    process->parser.index = index;
+    return index < tokens->count ? index : -1;
 }
 
-static struct token *token_next()
+static struct token *token_next(struct compile_process *process)
 {
-    struct token *next_token = vector_peek_no_increment(current_compiler->token_vec);
-    parse_ignore_nl_or_comment(next_token);
-    current_compiler->pos = next_token->pos;
-    parser_last_token = next_token;
-    return vector_peek(current_compiler->token_vec);
+    int index = parse_ignore_nl_or_comment(process);
+    if (index < 0)
+    {
+        return NULL;
+    }
+    struct token *next_token = &process->parser.last_token;
+    token_store_get(process->tokens, index, next_token);
+    process->loc = next_token->loc;
+    process->parser.index++;
+    return next_token;
 }
 
-static struct token *token_peek()
+static int token_peek(struct compile_process *process)
 {
-    struct token *next_token = vector_peek_no_increment(current_compiler->token_vec);
-    parse_ignore_nl_or_comment(next_token);
-    return next_token;
+    return parse_ignore_nl_or_comment(process);
 }
 
-void *parse_single_token_to_node()
+void parse_single_token_to_node(struct compile_process *process)
 {
-    struct token *token = token_next();
-    struct node *node = NULL;
+    struct token *token = token_next(process);
     switch (token->type)
     {
     case TOKEN_TYPE_NUMBER:
-        node = node_create(&(struct node){.type = NODE_TYPE_NUMBER, .llnum = token->llnum});
+        node_create(process, &(struct node){.type = NODE_TYPE_NUMBER, .value = node_number_value(process, token->llnum)});
         // printf("node number: %lld\n", node->llnum);
         // printf("node number: %c\n", token->cval);
         break;
 
     case TOKEN_TYPE_IDENTIFIER:
-        node = node_create(&(struct node){.type = NODE_TYPE_IDENTIFIER, .sval = token->sval});
+        node_create(process, &(struct node){.type = NODE_TYPE_IDENTIFIER, .value = intern_id(token->sval)});
         // printf("node identifier: %s\n", node->sval); 
         break;
 
     case TOKEN_TYPE_STRING:
-        node = node_create(&(struct node){.type = NODE_TYPE_STRING, .sval = token->sval});
+        node_create(process, &(struct node){.type = NODE_TYPE_STRING, .value = intern_id(token->sval)});
         // printf("node string: %s\n", node->sval);
         break;
 
     default:
-        compiler_error(current_compiler, "This is not a single tokne that can be converted to a node");
+        compiler_error(process, "This is not a single tokne that can be converted to a node");
+    }
+}
+
+// 二元运算符的优先级, 越大结合得越紧
+enum
+{
+    PARSE_PRECEDENCE_NONE,
+    PARSE_PRECEDENCE_COMMA,
+    PARSE_PRECEDENCE_ASSIGNMENT,
+    PARSE_PRECEDENCE_TERNARY,
+    PARSE_PRECEDENCE_LOGICAL_OR,
+    PARSE_PRECEDENCE_LOGICAL_AND,
+    PARSE_PRECEDENCE_BITWISE_OR,
+    PARSE_PRECEDENCE_BITWISE_XOR,
+    PARSE_PRECEDENCE_BITWISE_AND,
+    PARSE_PRECEDENCE_EQUALITY,
+    PARSE_PRECEDENCE_RELATIONAL,
+    PARSE_PRECEDENCE_SHIFT,
+    PARSE_PRECEDENCE_ADDITIVE,
+    PARSE_PRECEDENCE_MULTIPLICATIVE
+};
+
+// 超过这个深度直接报错, 不然很深的括号会把栈用完
+#define PARSE_MAX_DEPTH 1024
+
+struct parse_binary_operator
+{
+    uint8_t precedence;
+    // 右结合: 赋值和?:
+    bool right;
+};
+
+// 不在表里的运算符不能出现在两个操作数中间
+static const struct parse_binary_operator parse_binary_operators[OPERATOR_COUNT] = {
+    [OPERATOR_COMMA] = {PARSE_PRECEDENCE_COMMA, false},
+    [OPERATOR_ASSIGN] = {PARSE_PRECEDENCE_ASSIGNMENT, true},
+    [OPERATOR_ADD_ASSIGN] = {PARSE_PRECEDENCE_ASSIGNMENT, true},
+    [OPERATOR_SUB_ASSIGN] = {PARSE_PRECEDENCE_ASSIGNMENT, true},
+    [OPERATOR_MUL_ASSIGN] = {PARSE_PRECEDENCE_ASSIGNMENT, true},
+    [OPERATOR_DIV_ASSIGN] = {PARSE_PRECEDENCE_ASSIGNMENT, true},
+    [OPERATOR_MOD_ASSIGN] = {PARSE_PRECEDENCE_ASSIGNMENT, true},
+    [OPERATOR_AND_ASSIGN] = {PARSE_PRECEDENCE_ASSIGNMENT, true},
+    [OPERATOR_OR_ASSIGN] = {PARSE_PRECEDENCE_ASSIGNMENT, true},
+    [OPERATOR_XOR_ASSIGN] = {PARSE_PRECEDENCE_ASSIGNMENT, true},
+    [OPERATOR_SHL_ASSIGN] = {PARSE_PRECEDENCE_ASSIGNMENT, true},
+    [OPERATOR_SHR_ASSIGN] = {PARSE_PRECEDENCE_ASSIGNMENT, true},
+    [OPERATOR_QUESTION] = {PARSE_PRECEDENCE_TERNARY, true},
+    [OPERATOR_LOGICAL_OR] = {PARSE_PRECEDENCE_LOGICAL_OR, false},
+    [OPERATOR_LOGICAL_AND] = {PARSE_PRECEDENCE_LOGICAL_AND, false},
+    [OPERATOR_BITWISE_OR] = {PARSE_PRECEDENCE_BITWISE_OR, false},
+    [OPERATOR_BITWISE_XOR] = {PARSE_PRECEDENCE_BITWISE_XOR, false},
+    [OPERATOR_BITWISE_AND] = {PARSE_PRECEDENCE_BITWISE_AND, false},
+    [OPERATOR_EQ] = {PARSE_PRECEDENCE_EQUALITY, false},
+    [OPERATOR_NE] = {PARSE_PRECEDENCE_EQUALITY, false},
+    [OPERATOR_LT] = {PARSE_PRECEDENCE_RELATIONAL, false},
+    [OPERATOR_GT] = {PARSE_PRECEDENCE_RELATIONAL, false},
+    [OPERATOR_LE] = {PARSE_PRECEDENCE_RELATIONAL, false},
+    [OPERATOR_GE] = {PARSE_PRECEDENCE_RELATIONAL, false},
+    [OPERATOR_SHL] = {PARSE_PRECEDENCE_SHIFT, false},
+    [OPERATOR_SHR] = {PARSE_PRECEDENCE_SHIFT, false},
+    [OPERATOR_PLUS] = {PARSE_PRECEDENCE_ADDITIVE, false},
+    [OPERATOR_MINUS] = {PARSE_PRECEDENCE_ADDITIVE, false},
+    [OPERATOR_STAR] = {PARSE_PRECEDENCE_MULTIPLICATIVE, false},
+    [OPERATOR_SLASH] = {PARSE_PRECEDENCE_MULTIPLICATIVE, false},
+    [OPERATOR_PERCENT] = {PARSE_PRECEDENCE_MULTIPLICATIVE, false}};
+
+// 可以写在操作数前面的运算符, '('另外处理
+static const bool parse_prefix_operators[OPERATOR_COUNT] = {
+    [OPERATOR_PLUS] = true,
+    [OPERATOR_MINUS] = true,
+    [OPERATOR_STAR] = true,
+    [OPERATOR_BITWISE_AND] = true,
+    [OPERATOR_LOGICAL_NOT] = true,
+    [OPERATOR_BITWISE_NOT] = true,
+    [OPERATOR_INCREMENT] = true,
+    [OPERATOR_DECREMENT] = true};
+
+// 能开始一个类型名的keyword
+static const bool parse_type_keywords[KEYWORD_COUNT] = {
+    [KEYWORD_UNSIGNED] = true,
+    [KEYWORD_SIGNED] = true,
+    [KEYWORD_CHAR] = true,
+    [KEYWORD_SHORT] = true,
+    [KEYWORD_INT] = true,
+    [KEYWORD_FLOAT] = true,
+    [KEYWORD_DOUBLE] = true,
+    [KEYWORD_LONG] = true,
+    [KEYWORD_VOID] = true,
+    [KEYWORD_STRUCT] = true,
+    [KEYWORD_UNION] = true,
+    [KEYWORD_CONST] = true,
+    [KEYWORD_RESTRICT] = true};
+
+static void parse_expression(struct compile_process *process, int min_precedence);
+static void parse_unary(struct compile_process *process);
+
+// 语法错误. 顶层的表达式是试着解析的, 这时不报错, 跳回parse_top_level_expression
+#define PARSE_ERROR(process, ...)                       \
+    do                                                  \
+    {                                                   \
+        if ((process)->parser.recover)                  \
+            longjmp(*(process)->parser.recover, 1);     \
+        compiler_error(process, __VA_ARGS__);           \
+    } while (0)
+
+// 只看type和value列, 不取出整个token
+static int parse_peek_operator(struct compile_process *process)
+{
+    int index = token_peek(process);
+    if (index < 0 || process->tokens->type[index] != TOKEN_TYPE_OPERATOR)
+    {
+        return OPERATOR_NONE;
     }
+    return process->tokens->value[index];
+}
+
+static bool parse_peek_symbol(struct compile_process *process, char c)
+{
+    int index = token_peek(process);
+    return index >= 0 && process->tokens->type[index] == TOKEN_TYPE_SYMBOL && process->tokens->value[index] == (unsigned char)c;
 }
 
-int parse_next()
+static bool parse_peek_keyword(struct compile_process *process, int keyword)
 {
-    struct token *token = token_peek();
+    int index = token_peek(process);
+    return index >= 0 && process->tokens->type[index] == TOKEN_TYPE_KEYWORLD && process->tokens->value[index] == (uint32_t)keyword;
+}
+
+static bool parse_peek_type(struct compile_process *process)
+{
+    int index = token_peek(process);
+    return index >= 0 && process->tokens->type[index] == TOKEN_TYPE_KEYWORLD && parse_type_keywords[process->tokens->value[index]];
+}
+
+static struct token *parse_next_or_error(struct compile_process *process)
+{
+    struct token *token = token_next(process);
     if (!token)
     {
-        return -1;
+        PARSE_ERROR(process, "Unexpected end of file in an expression");
     }
-    // printf("%d\n", token->type);
-    switch (token->type)
+    return token;
+}
+
+static void parse_expect_symbol(struct compile_process *process, char c)
+{
+    struct token *token = parse_next_or_error(process);
+    if (token->type != TOKEN_TYPE_SYMBOL || token->cval != c)
+    {
+        PARSE_ERROR(process, "Expected '%c'", c);
+    }
+}
+
+// 栈顶的count个node按入栈顺序成为新node的子节点, 新node留在栈顶
+static node_id parse_reduce(struct compile_process *process, struct node *node, srcloc loc, int count)
+{
+    int base = vector_count(process->node_vec) - count;
+    node_id id = node_create(process, node);
+    node_at(process, id)->loc = loc;
+    for (int i = 0; i < count; i++)
+    {
+        node_append_child(process, id, *(node_id *)vector_at(process->node_vec, base + i));
+    }
+    vector_splice(process->node_vec, base, count, NULL, 0);
+    return id;
+}
+
+// 回退点只记下标和计数, 保存和回退都是O(1), 不复制token和node
+struct parse_checkpoint
+{
+    int index;
+    int depth;
+    srcloc loc;
+    struct node_mark nodes;
+};
+
+static void parse_checkpoint(struct compile_process *process, struct parse_checkpoint *checkpoint)
+{
+    checkpoint->index = process->parser.index;
+    checkpoint->depth = process->parser.depth;
+    checkpoint->loc = process->loc;
+    node_mark(process, &checkpoint->nodes);
+}
+
+static void parse_rewind(struct compile_process *process, struct parse_checkpoint *checkpoint)
+{
+    process->parser.index = checkpoint->index;
+    process->parser.depth = checkpoint->depth;
+    process->loc = checkpoint->loc;
+    node_rewind(process, &checkpoint->nodes);
+}
+
+// 不匹配时返回false而不是报错, 这时读掉的token和创建的node都会被parse_try丢掉
+typedef bool (*PARSE_SPECULATE_FUNCTION)(struct compile_process *process);
+
+static bool parse_try(struct compile_process *process, PARSE_SPECULATE_FUNCTION function)
+{
+    struct parse_checkpoint checkpoint;
+    parse_checkpoint(process, &checkpoint);
+    if (function(process))
+    {
+        return true;
+    }
+    parse_rewind(process, &checkpoint);
+    return false;
+}
+
+// int, unsigned long, struct abc
+// struct/union后面没有名字时返回false
+static bool parse_type_specifiers(struct compile_process *process)
+{
+    while (parse_peek_type(process))
+    {
+        struct token *token = token_next(process);
+        if (token->keyword == KEYWORD_STRUCT || token->keyword == KEYWORD_UNION)
+        {
+            token = token_next(process);
+            if (!token || token->type != TOKEN_TYPE_IDENTIFIER)
+                return false;
+        }
+    }
+    return true;
+}
+
+// * const *, 声明里每个声明符有自己的一份
+static void parse_pointers(struct compile_process *process)
+{
+    while (parse_peek_operator(process) == OPERATOR_STAR || parse_peek_keyword(process, KEYWORD_CONST) || parse_peek_keyword(process, KEYWORD_RESTRICT))
+    {
+        token_next(process);
+    }
+}
+
+// 下标[start, end)的token组成的TYPENAME
+static void parse_typename_node(struct compile_process *process, int start, int end, srcloc loc)
+{
+    if (end - start > UINT16_MAX)
+    {
+        compiler_error(process, "Type name is too long");
+    }
+    node_create(process, &(struct node){.type = NODE_TYPE_TYPENAME, .flag = end - start, .value = start});
+    node_at(process, node_peek(process))->loc = loc;
+}
+
+// unsigned long *, struct abc * const ...
+// struct/union后面没有名字时返回false
+static bool parse_type_name(struct compile_process *process)
+{
+    srcloc loc = process->loc;
+    int start = token_peek(process);
+    if (!parse_type_specifiers(process))
+    {
+        return false;
+    }
+    parse_pointers(process);
+    parse_typename_node(process, start, process->parser.index, loc);
+    return true;
+}
+
+static void parse_expect_type_name(struct compile_process *process)
+{
+    if (!parse_type_name(process))
+    {
+        PARSE_ERROR(process, "Expected a struct or union name");
+    }
+}
+
+// a[i], f(a, b), a.b, a->b, a++, a--
+static void parse_postfix(struct compile_process *process)
+{
+    while (1)
+    {
+        int op = parse_peek_operator(process);
+        if (op == OPERATOR_NONE)
+        {
+            return;
+        }
+        int index = token_peek(process);
+        srcloc loc = process->tokens->base + process->tokens->offset[index];
+        switch (op)
+        {
+        case OPERATOR_LEFT_BRACKET:
+            token_next(process);
+            parse_expression(process, PARSE_PRECEDENCE_COMMA);
+            parse_expect_symbol(process, ']');
+            parse_reduce(process, &(struct node){.type = NODE_TYPE_EXPRESSION, .value = op}, loc, 2);
+            break;
+
+        case OPERATOR_LEFT_PAREN:
+        {
+            token_next(process);
+            int count = 1;
+            if (!parse_peek_symbol(process, ')'))
+            {
+                do
+                {
+                    // 参数之间的逗号不是逗号运算符
+                    parse_expression(process, PARSE_PRECEDENCE_ASSIGNMENT);
+                    count++;
+                } while (parse_peek_operator(process) == OPERATOR_COMMA && token_next(process));
+            }
+            parse_expect_symbol(process, ')');
+            parse_reduce(process, &(struct node){.type = NODE_TYPE_EXPRESSION, .value = op}, loc, count);
+            break;
+        }
+
+        case OPERATOR_DOT:
+        case OPERATOR_ARROW:
+        {
+            token_next(process);
+            struct token *token = parse_next_or_error(process);
+            if (token->type != TOKEN_TYPE_IDENTIFIER)
+            {
+                PARSE_ERROR(process, "Expected a member name after '%s'", operator_str(op));
+            }
+            node_create(process, &(struct node){.type = NODE_TYPE_IDENTIFIER, .value = intern_id(token->sval)});
+            parse_reduce(process, &(struct node){.type = NODE_TYPE_EXPRESSION, .value = op}, loc, 2);
+            break;
+        }
+
+        case OPERATOR_INCREMENT:
+        case OPERATOR_DECREMENT:
+            token_next(process);
+            parse_reduce(process, &(struct node){.type = NODE_TYPE_UNARY, .flag = NODE_FLAG_POSTFIX, .value = op}, loc, 1);
+            break;
+
+        default:
+            return;
+        }
+    }
+}
+
+// 已经读掉了'(', 读括号里的表达式和')', 然后是后缀运算符
+static void parse_parentheses(struct compile_process *process, srcloc loc)
+{
+    parse_expression(process, PARSE_PRECEDENCE_COMMA);
+    parse_expect_symbol(process, ')');
+    parse_reduce(process, &(struct node){.type = NODE_TYPE_EXPRESSION_PARENTHESES}, loc, 1);
+    parse_postfix(process);
+}
+
+static void parse_sizeof(struct compile_process *process, srcloc loc)
+{
+    if (parse_peek_operator(process) == OPERATOR_LEFT_PAREN)
+    {
+        token_next(process);
+        srcloc paren_loc = process->loc;
+        if (!parse_peek_type(process))
+        {
+            // sizeof (a)[0] 是 sizeof ((a)[0])
+            parse_parentheses(process, paren_loc);
+        }
+        else
+        {
+            parse_expect_type_name(process);
+            parse_expect_symbol(process, ')');
+        }
+    }
+    else
+    {
+        parse_unary(process);
+    }
+    parse_reduce(process, &(struct node){.type = NODE_TYPE_UNARY, .flag = NODE_FLAG_SIZEOF}, loc, 1);
+}
+
+// 前缀运算符, cast, sizeof, 括号和单个token, 后面跟着后缀运算符
+static void parse_unary(struct compile_process *process)
+{
+    if (++process->parser.depth > PARSE_MAX_DEPTH)
+    {
+        compiler_error(process, "Expression is nested too deeply");
+    }
+    int index = token_peek(process);
+    if (index < 0)
+    {
+        PARSE_ERROR(process, "Unexpected end of file, expected an expression");
+    }
+    int type = process->tokens->type[index];
+    uint32_t value = process->tokens->value[index];
+    srcloc loc = process->tokens->base + process->tokens->offset[index];
+
+    if (type == TOKEN_TYPE_OPERATOR && parse_prefix_operators[value])
+    {
+        token_next(process);
+        parse_unary(process);
+        parse_reduce(process, &(struct node){.type = NODE_TYPE_UNARY, .value = value}, loc, 1);
+    }
+    else if (type == TOKEN_TYPE_OPERATOR && value == OPERATOR_LEFT_PAREN)
+    {
+        token_next(process);
+        if (!parse_peek_type(process))
+        {
+            parse_parentheses(process, loc);
+        }
+        else
+        {
+            // (type)x, 一个token的向前看就能和括号表达式区分开
+            parse_expect_type_name(process);
+            parse_expect_symbol(process, ')');
+            if (parse_peek_symbol(process, '{'))
+            {
+                PARSE_ERROR(process, "Compound literals are not supported yet");
+            }
+            parse_unary(process);
+            parse_reduce(process, &(struct node){.type = NODE_TYPE_CAST}, loc, 2);
+        }
+    }
+    else if (type == TOKEN_TYPE_KEYWORLD && value == KEYWORD_SIZEOF)
+    {
+        token_next(process);
+        parse_sizeof(process, loc);
+    }
+    else if (type == TOKEN_TYPE_NUMBER || type == TOKEN_TYPE_IDENTIFIER || type == TOKEN_TYPE_STRING)
+    {
+        parse_single_token_to_node(process);
+        parse_postfix(process);
+    }
+    else
+    {
+        token_next(process);
+        PARSE_ERROR(process, "Expected an expression");
+    }
+    process->parser.depth--;
+}
+
+// precedence climbing: 只处理优先级不低于min_precedence的二元运算符, 左结合的链在循环里完成, 不会递归
+static void parse_expression(struct compile_process *process, int min_precedence)
+{
+    parse_unary(process);
+    while (1)
+    {
+        int op = parse_peek_operator(process);
+        const struct parse_binary_operator *binary = &parse_binary_operators[op];
+        if (binary->precedence == PARSE_PRECEDENCE_NONE || binary->precedence < min_precedence)
+        {
+            return;
+        }
+        token_next(process);
+        srcloc loc = process->loc;
+        if (++process->parser.depth > PARSE_MAX_DEPTH)
+        {
+            compiler_error(process, "Expression is nested too deeply");
+        }
+
+        if (op == OPERATOR_QUESTION)
+        {
+            // a ? b : c, 中间可以是任意表达式
+            parse_expression(process, PARSE_PRECEDENCE_COMMA);
+            parse_expect_symbol(process, ':');
+            parse_expression(process, PARSE_PRECEDENCE_TERNARY);
+            parse_reduce(process, &(struct node){.type = NODE_TYPE_TENARY}, loc, 3);
+        }
+        else
+        {
+            parse_expression(process, binary->right ? binary->precedence : binary->precedence + 1);
+            parse_reduce(process, &(struct node){.type = NODE_TYPE_EXPRESSION, .value = op}, loc, 2);
+        }
+        process->parser.depth--;
+    }
+}
+
+// 这个token能开始一个表达式
+static bool parse_is_expression_start(struct compile_process *process, int index)
+{
+    uint32_t value = process->tokens->value[index];
+    switch (process->tokens->type[index])
     {
     case TOKEN_TYPE_NUMBER:
     case TOKEN_TYPE_IDENTIFIER:
     case TOKEN_TYPE_STRING:
-        parse_single_token_to_node();
-        break;
+        return true;
+    case TOKEN_TYPE_OPERATOR:
+        return parse_prefix_operators[value] || value == OPERATOR_LEFT_PAREN;
+    case TOKEN_TYPE_KEYWORLD:
+        return value == KEYWORD_SIZEOF;
+    }
+    return false;
+}
 
-    default:
-        token_next();
-        break;
+// 这个token打开一层括号时是1, 关上一层时是-1
+static int parse_bracket_depth(struct compile_process *process, int index)
+{
+    uint32_t value = process->tokens->value[index];
+    switch (process->tokens->type[index])
+    {
+    case TOKEN_TYPE_OPERATOR:
+        return value == OPERATOR_LEFT_PAREN || value == OPERATOR_LEFT_BRACKET;
+    case TOKEN_TYPE_SYMBOL:
+        return value == '{' ? 1 : (value == ')' || value == ']' || value == '}') ? -1 : 0;
+    }
+    return 0;
+}
+
+// 开括号已经读掉了, 跳过后面的token直到和它对应的闭括号, 没有闭括号时返回false
+static bool parse_skip_brackets(struct compile_process *process)
+{
+    int depth = 1;
+    while (depth)
+    {
+        int index = token_peek(process);
+        if (index < 0)
+        {
+            return false;
+        }
+        depth += parse_bracket_depth(process, index);
+        process->parser.index++;
+    }
+    return true;
+}
+
+// 跳过一个参数里剩下的token, 停在同一层的','或者')'前面
+static void parse_skip_parameter(struct compile_process *process)
+{
+    int depth = 0;
+    while (1)
+    {
+        int index = token_peek(process);
+        if (index < 0)
+        {
+            compiler_error(process, "Unexpected end of file in a parameter list");
+        }
+        if (depth == 0 && (parse_peek_operator(process) == OPERATOR_COMMA || parse_peek_symbol(process, ')')))
+        {
+            return;
+        }
+        depth += parse_bracket_depth(process, index);
+        process->parser.index++;
+    }
+}
+
+// a[10][], 每一维一个BRACKET, 返回维数
+static int parse_array_dimensions(struct compile_process *process)
+{
+    int count = 0;
+    while (parse_peek_operator(process) == OPERATOR_LEFT_BRACKET)
+    {
+        srcloc loc = process->tokens->base + process->tokens->offset[token_peek(process)];
+        token_next(process);
+        int children = 0;
+        if (!parse_peek_symbol(process, ']'))
+        {
+            parse_expression(process, PARSE_PRECEDENCE_ASSIGNMENT);
+            children++;
+        }
+        parse_expect_symbol(process, ']');
+        parse_reduce(process, &(struct node){.type = NODE_TYPE_BRACKET}, loc, children);
+        count++;
+    }
+    return count;
+}
+
+// int a, char *b[], const char *, 后面必须是','或者')'
+static bool parse_try_parameter(struct compile_process *process)
+{
+    if (!parse_type_name(process))
+    {
+        return false;
+    }
+    int index = token_peek(process);
+    if (index >= 0 && process->tokens->type[index] == TOKEN_TYPE_IDENTIFIER)
+    {
+        srcloc loc = process->tokens->base + process->tokens->offset[index];
+        uint32_t value = intern_id(token_next(process)->sval);
+        int count = 1 + parse_array_dimensions(process);
+        parse_reduce(process, &(struct node){.type = NODE_TYPE_VARIABLE, .value = value}, loc, count);
+    }
+    return parse_peek_operator(process) == OPERATOR_COMMA || parse_peek_symbol(process, ')');
+}
+
+// 已经读掉了'(', 参数是VARIABLE, 没有名字时是TYPENAME, 返回参数的数量
+// 函数指针参数还不支持, 只跳过那一个参数
+static int parse_parameters(struct compile_process *process)
+{
+    int count = 0;
+    while (!parse_peek_symbol(process, ')'))
+    {
+        if (parse_peek_operator(process) == OPERATOR_ELLIPSIS)
+        {
+            token_next(process);
+        }
+        else if (parse_peek_type(process) && parse_try(process, parse_try_parameter))
+        {
+            count++;
+        }
+        parse_skip_parameter(process);
+        if (parse_peek_operator(process) == OPERATOR_COMMA)
+        {
+            token_next(process);
+        }
+    }
+    token_next(process);
+    return count;
+}
+
+// name, 数组的维数和可能有的初始值, 它的TYPENAME已经在栈顶
+static void parse_declarator(struct compile_process *process, srcloc loc)
+{
+    uint32_t value = intern_id(token_next(process)->sval);
+    int count = 1 + parse_array_dimensions(process);
+    if (parse_peek_operator(process) == OPERATOR_ASSIGN)
+    {
+        token_next(process);
+        if (parse_peek_symbol(process, '{'))
+        {
+            // 初始化列表还不支持, 整个跳过
+            token_next(process);
+            if (!parse_skip_brackets(process))
+            {
+                compiler_error(process, "Unexpected end of file in an initializer");
+            }
+        }
+        else
+        {
+            parse_expression(process, PARSE_PRECEDENCE_ASSIGNMENT);
+            count++;
+        }
+    }
+    parse_reduce(process, &(struct node){.type = NODE_TYPE_VARIABLE, .value = value}, loc, count);
+}
+
+// int a[2] = {1, 2}; const char *s, **t; int main(int argc, char **argv)
+// int (*fp)(void)这样带括号的声明符还不支持, 返回false. 函数体和';'留给parse_next
+static bool parse_try_variable(struct compile_process *process)
+{
+    int start = token_peek(process);
+    srcloc loc = process->tokens->base + process->tokens->offset[start];
+    if (!parse_type_specifiers(process))
+    {
+        return false;
+    }
+    int pointers = token_peek(process);
+    parse_pointers(process);
+    int index = token_peek(process);
+    if (index < 0 || process->tokens->type[index] != TOKEN_TYPE_IDENTIFIER)
+    {
+        return false;
+    }
+    process->parser.index = index + 1;
+    int op = parse_peek_operator(process);
+    process->parser.index = index;
+
+    // 到这里已经确定是声明, 后面的错误就是真的错误
+    parse_typename_node(process, start, index, loc);
+    if (op == OPERATOR_LEFT_PAREN)
+    {
+        uint32_t value = intern_id(token_next(process)->sval);
+        token_next(process);
+        int count = 1 + parse_parameters(process);
+        parse_reduce(process, &(struct node){.type = NODE_TYPE_FUNCTION, .value = value}, loc, count);
+        return true;
+    }
+    parse_declarator(process, loc);
+    if (parse_peek_operator(process) != OPERATOR_COMMA)
+    {
+        return true;
+    }
+
+    // 第一个声明符的TYPENAME只留下它自己的'*', 前面的类型成为VARIABLE_LIST的第一个子节点
+    struct node_store *store = process->nodes;
+    node_id first = node_peek(process);
+    node_id first_type = store->nodes[first].first_child;
+    store->nodes[first_type].value = pointers;
+    store->nodes[first_type].flag = index - pointers;
+    store->nodes[first_type].loc = process->tokens->base + process->tokens->offset[pointers];
+    parse_typename_node(process, start, pointers, loc);
+    node_id *top = vector_at(process->node_vec, vector_count(process->node_vec) - 2);
+    top[0] = top[1];
+    top[1] = first;
+
+    int count = 2;
+    while (parse_peek_operator(process) == OPERATOR_COMMA)
+    {
+        token_next(process);
+        int declarator = token_peek(process);
+        srcloc declarator_loc = process->tokens->base + process->tokens->offset[declarator];
+        parse_pointers(process);
+        index = token_peek(process);
+        if (index < 0 || process->tokens->type[index] != TOKEN_TYPE_IDENTIFIER)
+        {
+            compiler_error(process, "Expected a variable name after ','");
+        }
+        parse_typename_node(process, declarator, index, declarator_loc);
+        parse_declarator(process, declarator_loc);
+        count++;
+    }
+    parse_reduce(process, &(struct node){.type = NODE_TYPE_VARIABLE_LIST}, loc, count);
+    return true;
+}
+
+// 跳到同一层的';'后面, 没有';'时跳到文件末尾
+static void parse_skip_declaration(struct compile_process *process)
+{
+    int depth = 0;
+    for (int index = token_peek(process); index >= 0; index = token_peek(process))
+    {
+        process->parser.index++;
+        if (depth == 0 && process->tokens->type[index] == TOKEN_TYPE_SYMBOL && process->tokens->value[index] == ';')
+        {
+            return;
+        }
+        depth += parse_bracket_depth(process, index);
+        if (depth < 0)
+            depth = 0;
+    }
+}
+
+// 还没有语句, for/if/while/switch后面括号里的内容不是一个表达式, 整个跳过
+static bool parse_skip_statement_header(struct compile_process *process)
+{
+    if (!parse_peek_keyword(process, KEYWORD_FOR) && !parse_peek_keyword(process, KEYWORD_IF) &&
+        !parse_peek_keyword(process, KEYWORD_WHILE) && !parse_peek_keyword(process, KEYWORD_SWITCH))
+    {
+        return false;
+    }
+    token_next(process);
+    if (parse_peek_operator(process) == OPERATOR_LEFT_PAREN)
+    {
+        token_next(process);
+        parse_skip_brackets(process);
+    }
+    return true;
+}
+
+// 顶层的表达式解析失败时不报错, 丢掉建了一半的node, 从出错的token后面接着解析
+// 和以前跳过不认识的token一样, 每个token最多被读一次
+static void parse_top_level_expression(struct compile_process *process)
+{
+    struct parse_checkpoint checkpoint;
+    parse_checkpoint(process, &checkpoint);
+    jmp_buf recover;
+    process->parser.recover = &recover;
+    if (setjmp(recover) == 0)
+    {
+        parse_expression(process, PARSE_PRECEDENCE_COMMA);
+    }
+    else
+    {
+        int index = process->parser.index;
+        parse_rewind(process, &checkpoint);
+        process->parser.index = index > checkpoint.index ? index : checkpoint.index + 1;
+    }
+    process->parser.recover = NULL;
+}
+
+int parse_next(struct compile_process *process)
+{
+    int index = token_peek(process);
+    if (index < 0)
+    {
+        return -1;
+    }
+    // printf("%d\n", process->tokens->type[index]);
+    // 还没有语句, 其余的token先跳过
+    if (parse_peek_type(process))
+    {
+        // 类型开头的不会是表达式, 不认识的声明整个跳过
+        if (!parse_try(process, parse_try_variable))
+        {
+            parse_skip_declaration(process);
+        }
+        return 0;
+    }
+    if (parse_skip_statement_header(process))
+    {
+        return 0;
+    }
+    if (parse_is_expression_start(process, index))
+    {
+        parse_top_level_expression(process);
+    }
+    else
+    {
+        token_next(process);
     }
 
     return 0;
 }
 
+// 栈上剩下的都是完整的顶层node, 按顺序挂到NODE_ROOT下面
+static void parse_attach_to_root(struct compile_process *process)
+{
+    for (int i = 0; i < vector_count(process->node_vec); i++)
+    {
+        node_append_child(process, NODE_ROOT, *(node_id *)vector_at(process->node_vec, i));
+    }
+    vector_clear(process->node_vec);
+}
+
 int parse(struct compile_process *process)
 {
-    current_compiler = process;
-    parser_last_token = NULL;
-    node_set_vector(process->node_vec, process->node_tree_vec);
+    // 从第一个token开始
+    memset(&process->parser, 0, sizeof(process->parser));
 
-    struct node *node = NULL;
-    // 初始化头指针index
-    vector_set_peek_pointer(process->token_vec, 0);
-    // printf("%d\n", vector_count(process->token_vec));
-    while (parse_next() == 0)
+    // printf("%d\n", process->tokens->count);
+    while (parse_next(process) == 0)
     {
-        node = node_peek();
-        vector_push(process->node_tree_vec, &node);
+        parse_attach_to_root(process);
     }
     // printf("length\n");
-    // printf("%d\n", vector_count(process->node_vec));
-    // printf("%d\n", vector_count(process->node_tree_vec));
+    TRACE(process, TRACE_PARSE, TRACE_LEVEL_INFO, "parse end: %i nodes\n", node_count(process));
     return PARSE_ALL_OK;
 }
@@ -0,0 +1,306 @@
+#include "compiler.h"
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "helpers/vector.h"
+#include "helpers/buffer.h"
+
+/*
+ * Requests and responses are flat lists of u32 values and u32 length prefixed strings.
+ * request:  argc, argv..., cwd, envc, env...
+ * response: exit code, out, err
+ */
+
+extern char **environ;
+
+// Upper bounds for what a client may make the server allocate
+#define SERVER_MAX_STR_LEN (64u * 1024 * 1024)
+#define SERVER_MAX_STR_COUNT (64u * 1024)
+
+const char *server_default_socket_path()
+{
+    static char path[108];
+    const char *env = getenv("PEACH_SOCKET");
+    if (env)
+    {
+        return env;
+    }
+    if (!path[0])
+    {
+        snprintf(path, sizeof(path), "/tmp/peachc-%u.sock", (unsigned)getuid());
+    }
+    return path;
+}
+
+static int server_write_all(int fd, const void *data, size_t size)
+{
+    const char *ptr = data;
+    while (size)
+    {
+        ssize_t res = write(fd, ptr, size);
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res <= 0)
+            return -1;
+        ptr += res;
+        size -= res;
+    }
+    return 0;
+}
+
+static int server_read_all(int fd, void *data, size_t size)
+{
+    char *ptr = data;
+    while (size)
+    {
+        ssize_t res = read(fd, ptr, size);
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res <= 0)
+            return -1;
+        ptr += res;
+        size -= res;
+    }
+    return 0;
+}
+
+static void server_put_u32(struct buffer *buffer, uint32_t value)
+{
+    buffer_write_n(buffer, (const char *)&value, sizeof(value));
+}
+
+static void server_put_str(struct buffer *buffer, const char *str, size_t len)
+{
+    server_put_u32(buffer, len);
+    buffer_write_n(buffer, str, len);
+}
+
+static int server_get_u32(int fd, uint32_t *value)
+{
+    return server_read_all(fd, value, sizeof(*value));
+}
+
+// Strings are NUL terminated in memory, the length prefix does not count the terminator
+static char *server_get_str(int fd, uint32_t *len_out)
+{
+    uint32_t len;
+    if (server_get_u32(fd, &len) < 0 || len > SERVER_MAX_STR_LEN)
+        return NULL;
+
+    char *str = malloc((size_t)len + 1);
+    if (!str)
+        return NULL;
+    if (server_read_all(fd, str, len) < 0)
+    {
+        free(str);
+        return NULL;
+    }
+    str[len] = 0x00;
+    if (len_out)
+        *len_out = len;
+    return str;
+}
+
+// Reads a count followed by that many strings into a NULL terminated vector
+static int server_get_str_list(int fd, struct vector *list)
+{
+    uint32_t count;
+    if (server_get_u32(fd, &count) < 0 || count > SERVER_MAX_STR_COUNT)
+        return -1;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        char *str = server_get_str(fd, NULL);
+        if (!str)
+            return -1;
+        vector_push(list, &str);
+    }
+    char *end = NULL;
+    vector_push(list, &end);
+    return 0;
+}
+
+static void server_free_str_list(struct vector *list)
+{
+    for (int i = 0; i < vector_count(list); i++)
+    {
+        free(*(char **)vector_at(list, i));
+    }
+    vector_free(list);
+}
+
+static void *server_connection(void *arg)
+{
+    int fd = (int)(intptr_t)arg;
+    struct vector *args = vector_create(sizeof(char *));
+    struct vector *env = vector_create(sizeof(char *));
+    char *cwd = NULL;
+
+    if (server_get_str_list(fd, args) < 0 || !(cwd = server_get_str(fd, NULL)) || server_get_str_list(fd, env) < 0)
+    {
+        goto out;
+    }
+
+    struct buffer *out = buffer_create();
+    struct buffer *err = buffer_create();
+    int res = driver_main(vector_count(args) - 1, vector_data_ptr(args), cwd, vector_data_ptr(env), out, err);
+
+    struct buffer *response = buffer_create();
+    server_put_u32(response, res);
+    server_put_str(response, buffer_ptr(out), out->len);
+    server_put_str(response, buffer_ptr(err), err->len);
+    server_write_all(fd, buffer_ptr(response), response->len);
+    buffer_free(response);
+    buffer_free(out);
+    buffer_free(err);
+
+out:
+    free(cwd);
+    server_free_str_list(args);
+    server_free_str_list(env);
+    close(fd);
+    return NULL;
+}
+
+static int server_socket_address(const char *socket_path, struct sockaddr_un *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr->sun_path))
+    {
+        return -1;
+    }
+    strcpy(addr->sun_path, socket_path);
+    return 0;
+}
+
+int server_main(const char *socket_path)
+{
+    struct sockaddr_un addr;
+    if (server_socket_address(socket_path, &addr) < 0)
+    {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return 1;
+    }
+
+    // A client that goes away mid response must not take the server down with it
+    signal(SIGPIPE, SIG_IGN);
+
+    // Only a socket nobody answers on is stale, a live server keeps its socket
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe >= 0 && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+    {
+        close(probe);
+        fprintf(stderr, "A server is already listening on %s\n", socket_path);
+        return 1;
+    }
+    bool stale = probe >= 0 && errno == ECONNREFUSED;
+    if (probe >= 0)
+        close(probe);
+    if (stale)
+        unlink(socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 64) < 0)
+    {
+        fprintf(stderr, "Could not listen on %s: %s\n", socket_path, strerror(errno));
+        return 1;
+    }
+
+    printf("Listening on %s\n", socket_path);
+    fflush(stdout);
+    while (1)
+    {
+        int client = accept(fd, NULL, NULL);
+        if (client < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            fprintf(stderr, "accept failed: %s\n", strerror(errno));
+            break;
+        }
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, server_connection, (void *)(intptr_t)client) != 0)
+        {
+            close(client);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    close(fd);
+    return 1;
+}
+
+int client_main(const char *socket_path, int argc, const char **argv)
+{
+    struct sockaddr_un addr;
+    if (server_socket_address(socket_path, &addr) < 0)
+    {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd)))
+    {
+        close(fd);
+        return -1;
+    }
+
+    struct buffer *request = buffer_create();
+    server_put_u32(request, argc);
+    for (int i = 0; i < argc; i++)
+    {
+        server_put_str(request, argv[i], strlen(argv[i]));
+    }
+    server_put_str(request, cwd, strlen(cwd));
+
+    uint32_t envc = 0;
+    while (environ[envc])
+        envc++;
+    server_put_u32(request, envc);
+    for (uint32_t i = 0; i < envc; i++)
+    {
+        server_put_str(request, environ[i], strlen(environ[i]));
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    int sent = server_write_all(fd, buffer_ptr(request), request->len);
+    buffer_free(request);
+
+    uint32_t res;
+    uint32_t out_len = 0;
+    uint32_t err_len = 0;
+    char *out = NULL;
+    char *err = NULL;
+    if (sent < 0 || server_get_u32(fd, &res) < 0 || !(out = server_get_str(fd, &out_len)) || !(err = server_get_str(fd, &err_len)))
+    {
+        // The request may already have run, don't compile a second time
+        fprintf(stderr, "Lost connection to compile server %s\n", socket_path);
+        res = 1;
+    }
+    else
+    {
+        fwrite(err, 1, err_len, stderr);
+        fwrite(out, 1, out_len, stdout);
+    }
+
+    free(out);
+    free(err);
+    close(fd);
+    return res;
+}
@@ -0,0 +1,127 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include "helpers/scan.h"
+#include <assert.h>
+
+VECTOR_DEFINE_TYPED(source_file_vec, struct source_file)
+
+struct source_file *source_file_get(struct compile_process *process, int file)
+{
+    assert(file > 0 && file <= vector_count(process->files));
+    return source_file_vec_at(process->files, file - 1);
+}
+
+// 下一个文件的base, 每个文件多占一个位置给文件末尾
+static srcloc source_file_next_base(struct compile_process *process)
+{
+    struct source_file *last = source_file_vec_back(process->files);
+    return last ? last->base + last->size + 1 : 1;
+}
+
+int source_file_add(struct compile_process *process, const char *name, const char *data, size_t size)
+{
+    srcloc base = source_file_next_base(process);
+    if (size >= UINT32_MAX - base)
+    {
+        compiler_error(process, "Source files are too large, the locations do not fit in 32 bits");
+    }
+    source_file_vec_push(process->files, (struct source_file){.name = name, .data = data, .size = size, .base = base});
+    return vector_count(process->files);
+}
+
+int source_file_update(struct compile_process *process, int file, const char *data, size_t size, size_t gap, size_t gap_len)
+{
+    struct source_file *source = source_file_get(process, file);
+    // 后面还有文件的话位置空间不能变大, 改用一个新的id
+    if (file != vector_count(process->files) && size > source->size)
+    {
+        file = source_file_add(process, source->name, data, size);
+        source = source_file_get(process, file);
+        source->gap = gap;
+        source->gap_len = gap_len;
+        return file;
+    }
+    if (size >= UINT32_MAX - source->base)
+    {
+        compiler_error(process, "Source files are too large, the locations do not fit in 32 bits");
+    }
+    free(source->line_starts);
+    source->line_starts = NULL;
+    source->line_count = 0;
+    source->data = data;
+    source->size = size;
+    source->gap = gap;
+    source->gap_len = gap_len;
+    return file;
+}
+
+void source_files_clear(struct compile_process *process)
+{
+    for (int i = 0; i < vector_count(process->files); i++)
+    {
+        free(source_file_vec_at(process->files, i)->line_starts);
+    }
+    vector_clear(process->files);
+}
+
+// 第一次要行号时才扫描整个文件, line_starts[i]是第i + 1行开始的偏移
+// gap前后分两段扫, gap之后的偏移从data + gap_len算起
+static void source_file_build_lines(struct source_file *source)
+{
+    const char *gap = source->data + source->gap;
+    const char *after = source->data + source->gap_len;
+    const char *end = after + source->size;
+    size_t before_count = scan_lines(source->data, gap, source->data, NULL);
+    size_t count = before_count + scan_lines(gap + source->gap_len, end, after, NULL);
+    source->line_starts = malloc((count + 1) * sizeof(uint32_t));
+    source->line_starts[0] = 0;
+    scan_lines(source->data, gap, source->data, source->line_starts + 1);
+    scan_lines(gap + source->gap_len, end, after, source->line_starts + 1 + before_count);
+    source->line_count = count + 1;
+}
+
+static struct source_file *source_file_for_loc(struct compile_process *process, srcloc loc)
+{
+    int low = 0;
+    int high = vector_count(process->files);
+    while (low < high)
+    {
+        int mid = low + (high - low) / 2;
+        if (source_file_vec_at(process->files, mid)->base <= loc)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (low == 0)
+    {
+        return NULL;
+    }
+    struct source_file *source = source_file_vec_at(process->files, low - 1);
+    return loc - source->base <= source->size ? source : NULL;
+}
+
+struct pos srcloc_resolve(struct compile_process *process, srcloc loc)
+{
+    struct source_file *source = loc ? source_file_for_loc(process, loc) : NULL;
+    if (!source)
+    {
+        return (struct pos){.line = 1, .col = 1, .filename = process->ifile.abs_path};
+    }
+    if (!source->line_starts)
+    {
+        source_file_build_lines(source);
+    }
+
+    uint32_t offset = loc - source->base;
+    uint32_t low = 0;
+    uint32_t high = source->line_count;
+    while (low < high)
+    {
+        uint32_t mid = low + (high - low) / 2;
+        if (source->line_starts[mid] <= offset)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return (struct pos){.line = low, .col = offset - source->line_starts[low - 1] + 1, .filename = source->name};
+}
@@ -0,0 +1,367 @@
+#include "compiler.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <assert.h>
+#endif
+#include "helpers/buffer.h"
+#include "helpers/intern.h"
+
+/*
+ * .ptok 文件: header, token数组, 字符串表, 源码
+ * 字符串表里每项是 u32长度 + 字符串 + 0
+ * key只用来找文件, 源码逐字节比较之后才用缓存, hash碰撞不会拿到别的文件的token
+ */
+
+// token或header的布局改变时加一
+#define TOKCACHE_VERSION 5
+
+struct tokcache_header
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint64_t source_size;
+    uint32_t flags;
+    uint32_t token_count;
+    uint32_t string_count;
+    uint32_t string_bytes;
+};
+
+struct tokcache_token
+{
+    uint8_t type;
+    uint8_t whitespace;
+    uint8_t num_type;
+    uint8_t reserved;
+    int32_t flags;
+    // KEYWORD_xxx 或 OPERATOR_xxx
+    uint32_t kind;
+    // identifier/string是字符串表的下标, comment是在源码中的偏移
+    uint32_t str;
+    uint32_t slen;
+    uint32_t offset;
+    // lex_relex_tokens 靠它判断token是不是在括号外面
+    struct span between_brackets;
+    // number/symbol/newline 的union原样保存
+    uint64_t value;
+};
+
+static const char tokcache_magic[4] = {'P', 'T', 'O', 'K'};
+
+uint64_t tokcache_key(struct compile_process *process)
+{
+    // FNV-1a 64
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const unsigned char *data = (const unsigned char *)process->ifile.data;
+    for (size_t i = 0; i < process->ifile.size; i++)
+    {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    // 同样的源码用不同的flags lex出来的token可能不同
+    hash ^= (uint64_t)(uint32_t)process->flags << 32 | TOKCACHE_VERSION;
+    hash *= 0x100000001b3ULL;
+    return hash;
+}
+
+static void tokcache_path(struct compile_process *process, uint64_t key, struct buffer *path)
+{
+    buffer_printf(path, "%s/%016llx.ptok", process->cache_dir, (unsigned long long)key);
+}
+
+static int tokcache_write_all(int fd, const void *data, size_t size)
+{
+    const char *ptr = data;
+    while (size)
+    {
+        ssize_t res = write(fd, ptr, size);
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res <= 0)
+            return -1;
+        ptr += res;
+        size -= res;
+    }
+    return 0;
+}
+
+int tokcache_store(struct compile_process *process, uint64_t key)
+{
+    if (!process->cache_dir || !process->tokens)
+    {
+        return -1;
+    }
+
+    struct token_store *tokens = process->tokens;
+    // 下面直接读各列, lex_relex留下的gap要先合上
+    assert(!tokens->tail);
+    int count = tokens->count;
+    struct tokcache_token *records = calloc(count ? count : 1, sizeof(struct tokcache_token));
+    struct buffer *strings = buffer_create();
+    // intern id(从1开始) -> 字符串表下标, 同一个字符串只写一次
+    size_t index_size = (intern_count(process->strings) + 1) * sizeof(uint32_t);
+    uint32_t *string_index = malloc(index_size);
+    memset(string_index, 0xff, index_size);
+    uint32_t string_count = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        struct token_cold *cold = &tokens->cold[i];
+        struct tokcache_token *record = &records[i];
+        record->type = tokens->type[i];
+        record->whitespace = cold->whitespace;
+        record->num_type = cold->num_type;
+        record->flags = cold->flags;
+        record->slen = cold->slen;
+        record->offset = tokens->offset[i];
+        record->between_brackets = cold->between_brackets;
+
+        switch (record->type)
+        {
+        case TOKEN_TYPE_IDENTIFIER:
+        case TOKEN_TYPE_STRING:
+        {
+            uint32_t id = tokens->value[i];
+            if (string_index[id] == UINT32_MAX)
+            {
+                const char *str = intern_at(process->strings, id);
+                uint32_t len = intern_len(str);
+                buffer_write_n(strings, (const char *)&len, sizeof(len));
+                buffer_write_n(strings, str, len + 1);
+                string_index[id] = string_count++;
+            }
+            record->str = string_index[id];
+        }
+        break;
+        case TOKEN_TYPE_COMMENT:
+            // 跳过 // 或 /*
+            record->str = tokens->offset[i] + 2;
+            break;
+        case TOKEN_TYPE_KEYWORLD:
+        case TOKEN_TYPE_OPERATOR:
+            record->kind = tokens->value[i];
+            break;
+        default:
+            record->value = token_store_number(tokens, i);
+        }
+    }
+
+    struct tokcache_header header = {
+        .version = TOKCACHE_VERSION,
+        .key = key,
+        .source_size = process->ifile.size,
+        .flags = process->flags,
+        .token_count = count,
+        .string_count = string_count,
+        .string_bytes = strings->len};
+    memcpy(header.magic, tokcache_magic, sizeof(header.magic));
+
+    // 先写临时文件再rename, 并行编译同一个文件时读者不会看到写了一半的缓存
+    mkdir(process->cache_dir, 0755);
+    struct buffer *path = buffer_create();
+    tokcache_path(process, key, path);
+    struct buffer *tmp_path = buffer_create();
+    buffer_printf(tmp_path, "%s.XXXXXX", (const char *)buffer_ptr(path));
+
+    int res = -1;
+    int fd = mkstemp(buffer_ptr(tmp_path));
+    if (fd >= 0)
+    {
+        if (tokcache_write_all(fd, &header, sizeof(header)) == 0 &&
+            tokcache_write_all(fd, records, count * sizeof(struct tokcache_token)) == 0 &&
+            tokcache_write_all(fd, buffer_ptr(strings), strings->len) == 0 &&
+            tokcache_write_all(fd, process->ifile.data, process->ifile.size) == 0 &&
+            close(fd) == 0)
+        {
+            fd = -1;
+            res = rename(buffer_ptr(tmp_path), buffer_ptr(path));
+        }
+        if (fd >= 0)
+            close(fd);
+        if (res < 0)
+            unlink(buffer_ptr(tmp_path));
+    }
+
+    buffer_free(tmp_path);
+    buffer_free(path);
+    free(string_index);
+    buffer_free(strings);
+    free(records);
+    return res;
+}
+
+static const char *tokcache_map(const char *path, size_t *size)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    struct stat st;
+    const char *data = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(struct tokcache_header))
+    {
+        *size = st.st_size;
+#ifndef _WIN32
+        data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+            data = NULL;
+#else
+        char *buff = malloc(*size);
+        if (read(fd, buff, *size) == (ssize_t)*size)
+            data = buff;
+        else
+            free(buff);
+#endif
+    }
+    close(fd);
+    return data;
+}
+
+static void tokcache_unmap(const char *data, size_t size)
+{
+#ifndef _WIN32
+    munmap((void *)data, size);
+#else
+    free((void *)data);
+#endif
+}
+
+static bool tokcache_header_valid(struct compile_process *process, uint64_t key, const struct tokcache_header *header, size_t size)
+{
+    if (memcmp(header->magic, tokcache_magic, sizeof(header->magic)) != 0 ||
+        header->version != TOKCACHE_VERSION || header->key != key ||
+        header->source_size != process->ifile.size || header->flags != (uint32_t)process->flags)
+    {
+        return false;
+    }
+    uint64_t expected = sizeof(struct tokcache_header) + (uint64_t)header->token_count * sizeof(struct tokcache_token) + header->string_bytes;
+    if (expected + header->source_size != size)
+    {
+        return false;
+    }
+    const char *source = (const char *)header + expected;
+    return memcmp(source, process->ifile.data, process->ifile.size) == 0;
+}
+
+// 把字符串表重新intern进当前的table, 之后的阶段仍然可以用指针比较
+static const char **tokcache_load_strings(struct compile_process *process, const struct tokcache_header *header, const char *strings)
+{
+    const char **interned = malloc((header->string_count ? header->string_count : 1) * sizeof(const char *));
+    const char *ptr = strings;
+    const char *end = strings + header->string_bytes;
+    for (uint32_t i = 0; i < header->string_count; i++)
+    {
+        uint32_t len;
+        if (end - ptr < (ptrdiff_t)sizeof(len))
+            goto corrupt;
+        memcpy(&len, ptr, sizeof(len));
+        ptr += sizeof(len);
+        if ((uint64_t)(end - ptr) < (uint64_t)len + 1)
+            goto corrupt;
+        interned[i] = compile_process_intern(process, ptr, len);
+        ptr += len + 1;
+    }
+    return interned;
+
+corrupt:
+    free(interned);
+    return NULL;
+}
+
+int tokcache_load(struct compile_process *process, uint64_t key)
+{
+    if (!process->cache_dir)
+    {
+        return -1;
+    }
+
+    struct buffer *path = buffer_create();
+    tokcache_path(process, key, path);
+    size_t size = 0;
+    const char *data = tokcache_map(buffer_ptr(path), &size);
+    buffer_free(path);
+    if (!data)
+    {
+        return -1;
+    }
+
+    const struct tokcache_header *header = (const struct tokcache_header *)data;
+    const struct tokcache_token *records = (const struct tokcache_token *)(header + 1);
+    const char **strings = NULL;
+    struct token_store *tokens = NULL;
+    if (!tokcache_header_valid(process, key, header, size) ||
+        !(strings = tokcache_load_strings(process, header, (const char *)(records + header->token_count))))
+    {
+        goto miss;
+    }
+
+    tokens = token_store_create(process->strings);
+    tokens->source = process->ifile.data;
+    token_store_reserve(tokens, header->token_count);
+    for (uint32_t i = 0; i < header->token_count; i++)
+    {
+        const struct tokcache_token *record = &records[i];
+        struct token token = {
+            .type = record->type,
+            .flags = record->flags,
+            .num.type = record->num_type,
+            .slen = record->slen,
+            .offset = record->offset,
+            .whitespace = record->whitespace,
+            .between_brackets = record->between_brackets};
+        if ((uint64_t)record->between_brackets.offset + record->between_brackets.len > process->ifile.size)
+            goto miss;
+
+        switch (record->type)
+        {
+        case TOKEN_TYPE_IDENTIFIER:
+        case TOKEN_TYPE_STRING:
+            if (record->str >= header->string_count)
+                goto miss;
+            token.sval = strings[record->str];
+            break;
+        case TOKEN_TYPE_COMMENT:
+            if ((uint64_t)record->str + record->slen > process->ifile.size || record->str != (uint64_t)record->offset + 2)
+                goto miss;
+            token.sval = process->ifile.data + record->str;
+            break;
+        case TOKEN_TYPE_KEYWORLD:
+            if (record->kind <= KEYWORD_NONE || record->kind >= KEYWORD_COUNT)
+                goto miss;
+            token.keyword = record->kind;
+            token.sval = keyword_str(record->kind);
+            break;
+        case TOKEN_TYPE_OPERATOR:
+            if (record->kind <= OPERATOR_NONE || record->kind >= OPERATOR_COUNT)
+                goto miss;
+            token.op = record->kind;
+            token.sval = operator_str(record->kind);
+            break;
+        default:
+            token.llnum = record->value;
+        }
+        token_store_push(tokens, &token);
+    }
+
+    free(strings);
+    tokcache_unmap(data, size);
+    int file = source_file_add(process, process->ifile.abs_path, process->ifile.data, process->ifile.size);
+    tokens->base = source_file_get(process, file)->base;
+    process->tokens = tokens;
+    return 0;
+
+miss:
+    if (tokens)
+        token_store_free(tokens);
+    free(strings);
+    tokcache_unmap(data, size);
+    return -1;
+}
@@ -1,8 +1,195 @@
 #include "compiler.h"
 
-bool token_is_keyword(struct token *token, const char *keyword)
+static const char *keyword_spellings[KEYWORD_COUNT] = {
+    [KEYWORD_NONE] = NULL,
+    [KEYWORD_UNSIGNED] = "unsigned",
+    [KEYWORD_SIGNED] = "signed",
+    [KEYWORD_CHAR] = "char",
+    [KEYWORD_SHORT] = "short",
+    [KEYWORD_INT] = "int",
+    [KEYWORD_FLOAT] = "float",
+    [KEYWORD_DOUBLE] = "double",
+    [KEYWORD_LONG] = "long",
+    [KEYWORD_VOID] = "void",
+    [KEYWORD_STRUCT] = "struct",
+    [KEYWORD_UNION] = "union",
+    [KEYWORD_STATIC] = "static",
+    [KEYWORD_IGNORE_TYPECHECK] = "__ignore_typecheck__",
+    [KEYWORD_RETURN] = "return",
+    [KEYWORD_INCLUDE] = "include",
+    [KEYWORD_SIZEOF] = "sizeof",
+    [KEYWORD_IF] = "if",
+    [KEYWORD_ELSE] = "else",
+    [KEYWORD_WHILE] = "while",
+    [KEYWORD_FOR] = "for",
+    [KEYWORD_DO] = "do",
+    [KEYWORD_BREAK] = "break",
+    [KEYWORD_CONTINUE] = "continue",
+    [KEYWORD_SWITCH] = "switch",
+    [KEYWORD_CASE] = "case",
+    [KEYWORD_DEFAULT] = "default",
+    [KEYWORD_GOTO] = "goto",
+    [KEYWORD_TYPEDEF] = "typedef",
+    [KEYWORD_CONST] = "const",
+    [KEYWORD_EXTERN] = "extern",
+    [KEYWORD_RESTRICT] = "restrict"};
+
+// 长度+首字母(冲突时再看后面的字母)确定唯一的候选keyword
+static int keyword_candidate(const char *str, size_t len)
+{
+    switch (len)
+    {
+    case 2:
+        switch (str[0])
+        {
+        case 'i': return KEYWORD_IF;
+        case 'd': return KEYWORD_DO;
+        }
+        break;
+    case 3:
+        switch (str[0])
+        {
+        case 'i': return KEYWORD_INT;
+        case 'f': return KEYWORD_FOR;
+        }
+        break;
+    case 4:
+        switch (str[0])
+        {
+        case 'c': return str[1] == 'h' ? KEYWORD_CHAR : KEYWORD_CASE;
+        case 'l': return KEYWORD_LONG;
+        case 'v': return KEYWORD_VOID;
+        case 'e': return KEYWORD_ELSE;
+        case 'g': return KEYWORD_GOTO;
+        }
+        break;
+    case 5:
+        switch (str[0])
+        {
+        case 's': return KEYWORD_SHORT;
+        case 'f': return KEYWORD_FLOAT;
+        case 'u': return KEYWORD_UNION;
+        case 'w': return KEYWORD_WHILE;
+        case 'b': return KEYWORD_BREAK;
+        case 'c': return KEYWORD_CONST;
+        }
+        break;
+    case 6:
+        switch (str[0])
+        {
+        case 's':
+            switch (str[2])
+            {
+            case 'g': return KEYWORD_SIGNED;
+            case 'z': return KEYWORD_SIZEOF;
+            case 'r': return KEYWORD_STRUCT;
+            case 'a': return KEYWORD_STATIC;
+            case 'i': return KEYWORD_SWITCH;
+            }
+            break;
+        case 'd': return KEYWORD_DOUBLE;
+        case 'r': return KEYWORD_RETURN;
+        case 'e': return KEYWORD_EXTERN;
+        }
+        break;
+    case 7:
+        switch (str[0])
+        {
+        case 'i': return KEYWORD_INCLUDE;
+        case 'd': return KEYWORD_DEFAULT;
+        case 't': return KEYWORD_TYPEDEF;
+        }
+        break;
+    case 8:
+        switch (str[0])
+        {
+        case 'u': return KEYWORD_UNSIGNED;
+        case 'c': return KEYWORD_CONTINUE;
+        case 'r': return KEYWORD_RESTRICT;
+        }
+        break;
+    case 20:
+        return KEYWORD_IGNORE_TYPECHECK;
+    }
+    return KEYWORD_NONE;
+}
+
+int keyword_classify(const char *str, size_t len)
+{
+    int keyword = keyword_candidate(str, len);
+    if (keyword != KEYWORD_NONE && memcmp(str, keyword_spellings[keyword], len) == 0)
+    {
+        return keyword;
+    }
+    return KEYWORD_NONE;
+}
+
+const char *keyword_str(int keyword)
+{
+    return keyword_spellings[keyword];
+}
+
+static const char *operator_spellings[OPERATOR_COUNT] = {
+    [OPERATOR_NONE] = NULL,
+    [OPERATOR_PLUS] = "+",
+    [OPERATOR_MINUS] = "-",
+    [OPERATOR_STAR] = "*",
+    [OPERATOR_SLASH] = "/",
+    [OPERATOR_PERCENT] = "%",
+    [OPERATOR_INCREMENT] = "++",
+    [OPERATOR_DECREMENT] = "--",
+    [OPERATOR_ASSIGN] = "=",
+    [OPERATOR_ADD_ASSIGN] = "+=",
+    [OPERATOR_SUB_ASSIGN] = "-=",
+    [OPERATOR_MUL_ASSIGN] = "*=",
+    [OPERATOR_DIV_ASSIGN] = "/=",
+    [OPERATOR_MOD_ASSIGN] = "%=",
+    [OPERATOR_AND_ASSIGN] = "&=",
+    [OPERATOR_OR_ASSIGN] = "|=",
+    [OPERATOR_XOR_ASSIGN] = "^=",
+    [OPERATOR_SHL_ASSIGN] = "<<=",
+    [OPERATOR_SHR_ASSIGN] = ">>=",
+    [OPERATOR_EQ] = "==",
+    [OPERATOR_NE] = "!=",
+    [OPERATOR_LT] = "<",
+    [OPERATOR_GT] = ">",
+    [OPERATOR_LE] = "<=",
+    [OPERATOR_GE] = ">=",
+    [OPERATOR_LOGICAL_AND] = "&&",
+    [OPERATOR_LOGICAL_OR] = "||",
+    [OPERATOR_LOGICAL_NOT] = "!",
+    [OPERATOR_BITWISE_AND] = "&",
+    [OPERATOR_BITWISE_OR] = "|",
+    [OPERATOR_BITWISE_XOR] = "^",
+    [OPERATOR_BITWISE_NOT] = "~",
+    [OPERATOR_SHL] = "<<",
+    [OPERATOR_SHR] = ">>",
+    [OPERATOR_ARROW] = "->",
+    [OPERATOR_DOT] = ".",
+    [OPERATOR_ELLIPSIS] = "...",
+    [OPERATOR_QUESTION] = "?",
+    [OPERATOR_COMMA] = ",",
+    [OPERATOR_LEFT_PAREN] = "(",
+    [OPERATOR_LEFT_BRACKET] = "["};
+
+const char *operator_str(int op)
+{
+    return operator_spellings[op];
+}
+
+bool token_is_operator(struct token *token, int op)
+{
+    return token && token->type == TOKEN_TYPE_OPERATOR && token->op == op;
+}
+
+bool token_is_keyword(struct token *token, int keyword)
+{
+    return token && token->type == TOKEN_TYPE_KEYWORLD && token->keyword == keyword;
+}
+
+bool token_is_identifier(struct token *token, const char *name)
 {
-    return token->type == TOKEN_TYPE_KEYWORLD && S_EQ(token->sval, keyword);
+    return token->type == TOKEN_TYPE_IDENTIFIER && token->sval == name;
 }
 
 bool token_is_symbol(struct token *token, char c)
@@ -0,0 +1,281 @@
+#include "compiler.h"
+#include "helpers/intern.h"
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+// 第一次push时分配的token数量
+#define TOKEN_STORE_INITIAL_CAPACITY 1024
+
+struct token_store *token_store_create(struct intern_table *strings)
+{
+    struct token_store *store = calloc(1, sizeof(struct token_store));
+    store->strings = strings;
+    return store;
+}
+
+void token_store_free(struct token_store *store)
+{
+    free(store->type);
+    free(store->value);
+    free(store->offset);
+    free(store->cold);
+    free(store->wide);
+    free(store);
+}
+
+// 各列的[from, from + count)搬到to
+static void token_store_move(struct token_store *store, int to, int from, int count)
+{
+    memmove(&store->type[to], &store->type[from], count * sizeof(*store->type));
+    memmove(&store->value[to], &store->value[from], count * sizeof(*store->value));
+    memmove(&store->offset[to], &store->offset[from], count * sizeof(*store->offset));
+    memmove(&store->cold[to], &store->cold[from], count * sizeof(*store->cold));
+}
+
+// 每一列都放得下count个token
+void token_store_reserve(struct token_store *store, int count)
+{
+    if (count <= store->capacity)
+    {
+        return;
+    }
+    int old_capacity = store->capacity;
+    int capacity = store->capacity ? store->capacity : TOKEN_STORE_INITIAL_CAPACITY;
+    while (capacity < count)
+        capacity *= 2;
+    store->type = realloc(store->type, capacity * sizeof(*store->type));
+    store->value = realloc(store->value, capacity * sizeof(*store->value));
+    store->offset = realloc(store->offset, capacity * sizeof(*store->offset));
+    store->cold = realloc(store->cold, capacity * sizeof(*store->cold));
+    store->capacity = capacity;
+    store->allocated += capacity * (sizeof(*store->type) + sizeof(*store->value) + sizeof(*store->offset) + sizeof(*store->cold));
+    // tail要留在各列的最后
+    token_store_move(store, capacity - store->tail, old_capacity - store->tail, store->tail);
+}
+
+int token_store_slot(struct token_store *store, int index)
+{
+    return index < store->count - store->tail ? index : index + store->capacity - store->count;
+}
+
+uint32_t token_store_offset(struct token_store *store, int index)
+{
+    uint32_t offset = store->offset[token_store_slot(store, index)];
+    return index < store->count - store->tail ? offset : store->end - offset;
+}
+
+// 进出tail时换算位置, 两个方向是同一个公式. 括号里的token的between_brackets.offset不超过end, 换算之后也不会是0
+static void token_store_flip_offsets(struct token_store *store, int slot, int count)
+{
+    for (int i = slot; i < slot + count; i++)
+    {
+        store->offset[i] = store->end - store->offset[i];
+        uint32_t *brackets = &store->cold[i].between_brackets.offset;
+        if (*brackets)
+            *brackets = store->end + 1 - *brackets;
+    }
+}
+
+void token_store_move_gap(struct token_store *store, int index)
+{
+    assert(index >= 0 && index <= store->count);
+    int before = store->count - store->tail;
+    int gap = store->capacity - store->count;
+    if (index < before)
+    {
+        token_store_move(store, index + gap, index, before - index);
+        token_store_flip_offsets(store, index + gap, before - index);
+    }
+    else if (index > before)
+    {
+        token_store_flip_offsets(store, before + gap, index - before);
+        token_store_move(store, before, before + gap, index - before);
+    }
+    store->tail = store->count - index;
+}
+
+// 放不进31位的数字存到wide里, value记录下标, 先用删掉的token空出来的位置
+static uint32_t token_store_wide_value(struct token_store *store, unsigned long long number)
+{
+    if (number < TOKEN_VALUE_WIDE)
+    {
+        return number;
+    }
+    if (store->wide_free)
+    {
+        uint32_t index = store->wide_free - 1;
+        store->wide_free = store->wide[index];
+        store->wide[index] = number;
+        return TOKEN_VALUE_WIDE | index;
+    }
+    if (store->wide_count == store->wide_capacity)
+    {
+        store->wide_capacity = store->wide_capacity ? store->wide_capacity * 2 : 16;
+        store->wide = realloc(store->wide, store->wide_capacity * sizeof(*store->wide));
+        store->allocated += store->wide_capacity * sizeof(*store->wide);
+    }
+    store->wide[store->wide_count] = number;
+    return TOKEN_VALUE_WIDE | store->wide_count++;
+}
+
+void token_store_push(struct token_store *store, struct token *token)
+{
+    assert(!store->tail);
+    token_store_reserve(store, store->count + 1);
+    int index = store->count++;
+    uint32_t value = 0;
+    switch (token->type)
+    {
+    case TOKEN_TYPE_KEYWORLD:
+        value = token->keyword;
+        break;
+    case TOKEN_TYPE_OPERATOR:
+        value = token->op;
+        break;
+    case TOKEN_TYPE_IDENTIFIER:
+    case TOKEN_TYPE_STRING:
+        value = intern_id(token->sval);
+        break;
+    case TOKEN_TYPE_SYMBOL:
+        value = (unsigned char)token->cval;
+        break;
+    case TOKEN_TYPE_NUMBER:
+        value = token_store_wide_value(store, token->llnum);
+        break;
+    case TOKEN_TYPE_COMMENT:
+        // sval就是source + offset + 2, 取的时候再算
+        assert(token->sval == store->source + token->offset + 2);
+        break;
+    }
+    store->type[index] = token->type;
+    store->value[index] = value;
+    store->offset[index] = token->offset;
+    store->cold[index] = (struct token_cold){
+        .between_brackets = token->between_brackets,
+        .slen = token->slen,
+        .flags = token->flags,
+        .num_type = token->num.type,
+        .whitespace = token->whitespace};
+}
+
+void token_store_pop(struct token_store *store)
+{
+    assert(store->count > 0 && !store->tail);
+    store->count--;
+}
+
+unsigned long long token_store_number(struct token_store *store, int index)
+{
+    uint32_t value = store->value[token_store_slot(store, index)];
+    if (value & TOKEN_VALUE_WIDE)
+    {
+        return store->wide[value & ~TOKEN_VALUE_WIDE];
+    }
+    return value;
+}
+
+void token_store_get(struct token_store *store, int index, struct token *token)
+{
+    assert(index >= 0 && index < store->count);
+    int slot = token_store_slot(store, index);
+    bool in_tail = index >= store->count - store->tail;
+    struct token_cold *cold = &store->cold[slot];
+    uint32_t value = store->value[slot];
+    uint32_t offset = token_store_offset(store, index);
+    *token = (struct token){
+        .type = store->type[slot],
+        .flags = cold->flags,
+        .loc = store->base + offset,
+        .num.type = cold->num_type,
+        .slen = cold->slen,
+        .whitespace = cold->whitespace,
+        .offset = offset,
+        .between_brackets = cold->between_brackets};
+    if (in_tail && cold->between_brackets.offset)
+        token->between_brackets.offset = store->end + 1 - cold->between_brackets.offset;
+
+    switch (token->type)
+    {
+    case TOKEN_TYPE_KEYWORLD:
+        token->keyword = value;
+        token->sval = keyword_str(value);
+        break;
+    case TOKEN_TYPE_OPERATOR:
+        token->op = value;
+        token->sval = operator_str(value);
+        break;
+    case TOKEN_TYPE_IDENTIFIER:
+    case TOKEN_TYPE_STRING:
+        token->sval = intern_at(store->strings, value);
+        break;
+    case TOKEN_TYPE_SYMBOL:
+        token->cval = value;
+        break;
+    case TOKEN_TYPE_NUMBER:
+        token->llnum = token_store_number(store, index);
+        break;
+    case TOKEN_TYPE_COMMENT:
+        token->sval = (in_tail ? store->tail_source : store->source) + offset + 2;
+        break;
+    }
+}
+
+void token_store_splice(struct token_store *store, int index, int remove, struct token_store *src, ptrdiff_t delta)
+{
+    assert(index >= 0 && remove >= 0 && index + remove <= store->count);
+    int insert = src ? src->count : 0;
+    token_store_move_gap(store, index);
+
+    // 删掉的是tail开头的remove个token, 它们的wide位置留给之后的数字
+    int slot = store->capacity - store->tail;
+    for (int i = slot; i < slot + remove; i++)
+    {
+        uint32_t value = store->value[i];
+        if (store->type[i] == TOKEN_TYPE_NUMBER && (value & TOKEN_VALUE_WIDE))
+        {
+            store->wide[value & ~TOKEN_VALUE_WIDE] = store->wide_free;
+            store->wide_free = (value & ~TOKEN_VALUE_WIDE) + 1;
+        }
+    }
+    store->count -= remove;
+    store->tail -= remove;
+    // 剩下的tail离源码末尾的距离不变
+    store->end += delta;
+    if (!insert)
+    {
+        return;
+    }
+
+    // 新token放在tail的开头, gap还在index
+    token_store_reserve(store, store->count + insert);
+    slot = store->capacity - store->tail - insert;
+    memcpy(&store->type[slot], src->type, insert * sizeof(*store->type));
+    memcpy(&store->offset[slot], src->offset, insert * sizeof(*store->offset));
+    memcpy(&store->cold[slot], src->cold, insert * sizeof(*store->cold));
+    for (int i = 0; i < insert; i++)
+    {
+        uint32_t value = src->value[i];
+        // wide下标是src自己的, 重新放进store
+        if (src->type[i] == TOKEN_TYPE_NUMBER && (value & TOKEN_VALUE_WIDE))
+            value = token_store_wide_value(store, src->wide[value & ~TOKEN_VALUE_WIDE]);
+        store->value[slot + i] = value;
+    }
+    store->count += insert;
+    store->tail += insert;
+    token_store_flip_offsets(store, slot, insert);
+}
+
+bool token_store_is_nl_or_comment_or_newline_seperator(struct token_store *store, int index)
+{
+    int slot = token_store_slot(store, index);
+    int type = store->type[slot];
+    return type == TOKEN_TYPE_NEWLINE ||
+           type == TOKEN_TYPE_COMMENT ||
+           (type == TOKEN_TYPE_SYMBOL && store->value[slot] == '\\');
+}
+
+size_t token_store_bytes(struct token_store *store)
+{
+    return store->allocated;
+}
@@ -0,0 +1,235 @@
+#include "compiler.h"
+#include "helpers/buffer.h"
+#include "helpers/arena.h"
+#include "helpers/intern.h"
+#include "helpers/vector.h"
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+static const char *trace_category_names[TRACE_CATEGORY_COUNT] = {
+    [TRACE_LEX] = "lex",
+    [TRACE_PARSE] = "parse",
+    [TRACE_NODE] = "node"};
+
+static const char *trace_phase_names[COMPILE_PHASE_COUNT] = {
+    [COMPILE_PHASE_READ] = "read",
+    [COMPILE_PHASE_LEX] = "lex",
+    [COMPILE_PHASE_PARSE] = "parse",
+    [COMPILE_PHASE_CODEGEN] = "codegen"};
+
+static int trace_category(const char *name, size_t len)
+{
+    for (int i = 0; i < TRACE_CATEGORY_COUNT; i++)
+    {
+        if (strlen(trace_category_names[i]) == len && strncmp(trace_category_names[i], name, len) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int trace_parse(const char *spec, uint8_t levels[TRACE_CATEGORY_COUNT])
+{
+    memset(levels, 0, TRACE_CATEGORY_COUNT * sizeof(*levels));
+    const char *cur = spec;
+    while (cur && *cur)
+    {
+        size_t len = strcspn(cur, ",:");
+        const char *next = cur + len;
+        long level = TRACE_LEVEL_MAX;
+        if (*next == ':')
+        {
+            char *end = NULL;
+            level = strtol(next + 1, &end, 10);
+            if (end == next + 1 || level < TRACE_LEVEL_OFF || level > TRACE_LEVEL_MAX)
+            {
+                return -1;
+            }
+            next = end;
+        }
+        if (*next == ',')
+            next++;
+        else if (*next)
+            return -1;
+
+        if (len == 3 && strncmp(cur, "all", 3) == 0)
+        {
+            memset(levels, level, TRACE_CATEGORY_COUNT * sizeof(*levels));
+        }
+        else
+        {
+            int category = trace_category(cur, len);
+            if (category < 0)
+            {
+                return -1;
+            }
+            levels[category] = level;
+        }
+        cur = next;
+    }
+    return 0;
+}
+
+// 只写进内存里的buffer, 多个线程同时trace也不会抢stdio的锁
+void trace_printf(struct compile_process *process, const char *fmt, ...)
+{
+    if (!process->trace)
+    {
+        process->trace = buffer_create();
+        process->trace_owned = true;
+    }
+    va_list args;
+    va_start(args, fmt);
+    buffer_vprintf(process->trace, fmt, args);
+    va_end(args);
+}
+
+void trace_flush(struct compile_process *process)
+{
+    if (!process->trace_owned)
+    {
+        return;
+    }
+    const char *data = buffer_ptr(process->trace);
+    size_t left = process->trace->len;
+    fflush(stdout);
+    while (left > 0)
+    {
+        ssize_t res = write(STDOUT_FILENO, data, left);
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res <= 0)
+            break;
+        data += res;
+        left -= res;
+    }
+    buffer_free(process->trace);
+    process->trace = NULL;
+    process->trace_owned = false;
+}
+
+uint64_t trace_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// 编译器自己分配过的内存: arena, intern表, token的各列和node. 都只增不减, 两次的差就是之间分配的
+static size_t trace_process_bytes(struct compile_process *process)
+{
+    size_t bytes = process->arena->allocated + intern_bytes(process->strings);
+    if (process->tokens)
+        bytes += token_store_bytes(process->tokens);
+    bytes += node_store_bytes(process->nodes);
+    return bytes;
+}
+
+void trace_phase_begin(struct compile_process *process, int phase)
+{
+    if (!process->time_report)
+    {
+        return;
+    }
+    // bytes先记下开始时的总量, 结束时换成差值
+    process->phases[phase] = (struct compile_phase_time){.start_ns = trace_now_ns(), .bytes = trace_process_bytes(process)};
+}
+
+void trace_phase_end(struct compile_process *process, int phase)
+{
+    if (!process->time_report)
+    {
+        return;
+    }
+    struct compile_phase_time *time = &process->phases[phase];
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    time->end_ns = trace_now_ns();
+    time->tokens = process->tokens ? process->tokens->count : 0;
+    time->nodes = node_count(process);
+    size_t bytes = trace_process_bytes(process);
+    time->bytes = bytes > time->bytes ? bytes - time->bytes : 0;
+    time->peak_rss_kb = usage.ru_maxrss;
+    time->done = true;
+}
+
+void trace_time_report(struct buffer *out, const char *filename, struct compile_phase_time *phases)
+{
+    buffer_printf(out, "===== Time report: %s =====\n", filename);
+    buffer_printf(out, "%-8s %12s %10s %10s %12s %12s\n", "phase", "wall ms", "tokens", "nodes", "bytes", "peak rss KB");
+    uint64_t total_ns = 0;
+    size_t total_bytes = 0;
+    for (int i = 0; i < COMPILE_PHASE_COUNT; i++)
+    {
+        struct compile_phase_time *time = &phases[i];
+        if (!time->done)
+            continue;
+        uint64_t ns = time->end_ns - time->start_ns;
+        total_ns += ns;
+        total_bytes += time->bytes;
+        buffer_printf(out, "%-8s %12.3f %10i %10i %12zu %12ld\n", trace_phase_names[i], ns / 1e6, time->tokens, time->nodes, time->bytes, time->peak_rss_kb);
+    }
+    buffer_printf(out, "%-8s %12.3f %10s %10s %12zu\n", "total", total_ns / 1e6, "", "", total_bytes);
+}
+
+static void trace_json_string(struct buffer *out, const char *str)
+{
+    buffer_write(out, '"');
+    for (; *str; str++)
+    {
+        unsigned char c = *str;
+        if (c == '"' || c == '\\')
+        {
+            buffer_write(out, '\\');
+            buffer_write(out, c);
+        }
+        else if (c < 0x20)
+        {
+            buffer_printf(out, "\\u%04x", c);
+        }
+        else
+        {
+            buffer_write(out, c);
+        }
+    }
+    buffer_write(out, '"');
+}
+
+void trace_chrome_events(struct buffer *out, const char *filename, int tid, struct compile_phase_time *phases, uint64_t origin_ns)
+{
+    // 整个文件一个事件, 各阶段嵌套在里面
+    uint64_t start_ns = 0;
+    uint64_t end_ns = 0;
+    for (int i = 0; i < COMPILE_PHASE_COUNT; i++)
+    {
+        if (!phases[i].done)
+            continue;
+        if (!start_ns || phases[i].start_ns < start_ns)
+            start_ns = phases[i].start_ns;
+        if (phases[i].end_ns > end_ns)
+            end_ns = phases[i].end_ns;
+    }
+    if (!start_ns)
+    {
+        return;
+    }
+    buffer_printf(out, ",\n{\"name\":");
+    trace_json_string(out, filename);
+    buffer_printf(out, ",\"cat\":\"file\",\"ph\":\"X\",\"pid\":1,\"tid\":%i,\"ts\":%.3f,\"dur\":%.3f}",
+                  tid, (start_ns - origin_ns) / 1e3, (end_ns - start_ns) / 1e3);
+
+    for (int i = 0; i < COMPILE_PHASE_COUNT; i++)
+    {
+        struct compile_phase_time *time = &phases[i];
+        if (!time->done)
+            continue;
+        buffer_printf(out, ",\n{\"name\":\"%s\",\"cat\":\"phase\",\"ph\":\"X\",\"pid\":1,\"tid\":%i,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"file\":",
+                      trace_phase_names[i], tid, (time->start_ns - origin_ns) / 1e3, (time->end_ns - time->start_ns) / 1e3);
+        trace_json_string(out, filename);
+        buffer_printf(out, ",\"tokens\":%i,\"nodes\":%i,\"bytes\":%zu,\"peak_rss_kb\":%ld}}", time->tokens, time->nodes, time->bytes, time->peak_rss_kb);
+    }
+}